@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+
+#include "Globals.h"
+
+//parts of Renderer::drawFrame allocations are counted in
+enum FramePhase : uint32_t{
+    FRAME_PHASE_NONE, //outside of drawFrame: startup, input callbacks, teardown; never checked
+    FRAME_PHASE_WAIT, //waiting for the frame slot, collecting retired objects, acquiring the image
+    FRAME_PHASE_UPDATE, //per frame work of every subsystem
+    FRAME_PHASE_RECORD, //picking the cached command buffer, or recording it again
+    FRAME_PHASE_SUBMIT, //submit and present
+    FRAME_PHASE_COUNT
+};
+
+const char* const FRAME_PHASE_NAMES[FRAME_PHASE_COUNT] = {"none", "wait", "update", "record", "submit"};
+
+//counts global operator new calls per frame phase, in debug builds where the operators in main.cpp replace the default ones
+//a frame in which nothing changed (see Renderer::drawFrame) must not allocate at all, endFrame throws if it did
+//threads working on their own schedule, e.g. loaders, opt out with ignoreThisThread
+namespace AllocationTracker {
+    inline std::atomic<uint32_t> phase{FRAME_PHASE_NONE};
+    inline std::atomic<uint64_t> counts[FRAME_PHASE_COUNT];
+    inline thread_local bool ignored = false;
+    inline uint64_t frameCount = 0; //frames ended, main thread only
+    inline uint64_t steadyFrameCount = 0; //those of them that were checked, if this stays 0 the check never runs
+
+    inline void count(){
+        if(!ignored) counts[phase.load(std::memory_order_relaxed)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void ignoreThisThread(){ ignored = true; }
+    inline void setPhase(FramePhase p){ phase.store(p, std::memory_order_relaxed); }
+    inline uint64_t getCount(FramePhase p){ return counts[p].load(std::memory_order_relaxed); }
+    inline uint64_t getFrameCount(){ return frameCount; }
+    inline uint64_t getSteadyFrameCount(){ return steadyFrameCount; }
+
+    inline void beginFrame(){
+        for(auto& c : counts) c.store(0, std::memory_order_relaxed);
+        setPhase(FRAME_PHASE_WAIT);
+    }
+
+    //steady: nothing the frame depended on changed, so it had no reason to allocate
+    inline void endFrame(bool steady){
+        setPhase(FRAME_PHASE_NONE);
+        ++frameCount;
+        if(!steady) return;
+        ++steadyFrameCount;
+
+        uint64_t total = 0;
+        for(uint32_t p = FRAME_PHASE_WAIT; p < FRAME_PHASE_COUNT; ++p) total += getCount(static_cast<FramePhase>(p));
+        if(total == 0) return;
+
+        std::string message = "Steady state frame allocated " + std::to_string(total) + " times:";
+        for(uint32_t p = FRAME_PHASE_WAIT; p < FRAME_PHASE_COUNT; ++p) message += std::string(" ") + FRAME_PHASE_NAMES[p] + " " + std::to_string(getCount(static_cast<FramePhase>(p)));
+        throw std::runtime_error(message + "\n");
+    }
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <stdexcept>
+
+#include "DeviceHandler.h"
+#include "ImageStateTracker.h"
+
+//collects image transitions of tracked images and records all of them with one barrier call per sync point
+//the old state of every subresource comes from the device's ImageStateTracker, stages, access masks and layouts from what the image is used for next
+//subresources sharing an old state are merged into as few barriers as possible; uses vkCmdPipelineBarrier2KHR where VK_KHR_synchronization2 is enabled
+class BarrierBatcher{
+    struct AccessInfo{
+        VkPipelineStageFlags2KHR stage;
+        VkAccessFlags2KHR access;
+        VkImageLayout layout;
+        bool write;
+    };
+
+    std::vector<VkImageMemoryBarrier2KHR> pending;
+    std::vector<VkImageMemoryBarrier> legacyBarriers; //scratch for devices without synchronization2
+
+    DeviceHandler* deviceHandler;
+
+public:
+    BarrierBatcher(DeviceHandler*& _dh) : deviceHandler(_dh){
+
+    }
+
+    inline bool isEmpty(){ return pending.empty(); }
+
+    //queues moving the subresources of image into access, recorded at the next flush; the tracker already holds the new state afterwards
+    //reads following reads of the same kind need nothing; a subresource may be transitioned once per flush
+    void transition(VkImage image, ImageAccess access, uint32_t baseMip = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS, uint32_t baseLayer = 0, uint32_t layerCount = VK_REMAINING_ARRAY_LAYERS){
+        ImageStateTracker& states = deviceHandler->getImageStates();
+        uint32_t endMip = levelCount == VK_REMAINING_MIP_LEVELS ? states.getMipLevels(image) : baseMip + levelCount;
+        uint32_t endLayer = layerCount == VK_REMAINING_ARRAY_LAYERS ? states.getLayerCount(image) : baseLayer + layerCount;
+        AccessInfo next = getAccessInfo(access);
+        size_t firstNew = pending.size();
+
+        for(uint32_t mip = baseMip; mip < endMip; ++mip){
+            //runs of layers with the same old state become one barrier each
+            for(uint32_t layer = baseLayer; layer < endLayer;){
+                ImageAccess old = states.getState(image, mip, layer);
+                uint32_t runEnd = layer + 1;
+                while(runEnd < endLayer && states.getState(image, mip, runEnd) == old) ++runEnd;
+
+                if(old != access || next.write){
+                    checkNotPending(image, mip, layer, runEnd, firstNew);
+                    addBarrier(image, old, next, mip, layer, runEnd - layer, firstNew);
+                }
+                layer = runEnd;
+            }
+        }
+
+        states.setState(image, access, baseMip, endMip - baseMip, baseLayer, endLayer - baseLayer);
+    }
+
+    //records every queued transition, nothing if none are
+    void flush(VkCommandBuffer commandBuffer){
+        if(pending.empty()) return;
+
+        if(deviceHandler->isSynchronization2Supported()){
+            VkDependencyInfoKHR dependencyInfo{};
+            dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+            dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(pending.size());
+            dependencyInfo.pImageMemoryBarriers = pending.data();
+
+            vkCmdPipelineBarrier2KHR(commandBuffer, &dependencyInfo);
+        }
+        else recordLegacy(commandBuffer);
+
+        pending.clear();
+    }
+
+private:
+    //only stages and accesses that exist in the original flags are used, so the legacy fallback can narrow them
+    static AccessInfo getAccessInfo(ImageAccess access){
+        switch(access){
+            case IMAGE_ACCESS_TRANSFER_SRC: return {VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false};
+            case IMAGE_ACCESS_TRANSFER_DST: return {VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true};
+            case IMAGE_ACCESS_SHADER_READ: return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+            case IMAGE_ACCESS_COLOR_ATTACHMENT: return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true};
+            case IMAGE_ACCESS_DEPTH_ATTACHMENT: return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true};
+            default: return {VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT_KHR, 0, VK_IMAGE_LAYOUT_UNDEFINED, false};
+        }
+    }
+
+    //extends the barrier of the level above when it covers the same layers from the same state, so whole chains become one barrier
+    void addBarrier(VkImage image, ImageAccess old, const AccessInfo& next, uint32_t mip, uint32_t baseLayer, uint32_t layerCount, size_t firstNew){
+        AccessInfo previous = getAccessInfo(old);
+
+        for(size_t i = firstNew; i < pending.size(); ++i){
+            VkImageMemoryBarrier2KHR& barrier = pending[i];
+            VkImageSubresourceRange& range = barrier.subresourceRange;
+            if(barrier.oldLayout != previous.layout || barrier.srcStageMask != previous.stage || barrier.srcAccessMask != (previous.write ? previous.access : 0)) continue;
+            if(range.baseArrayLayer != baseLayer || range.layerCount != layerCount || range.baseMipLevel + range.levelCount != mip) continue;
+
+            ++range.levelCount;
+            return;
+        }
+
+        VkImageMemoryBarrier2KHR barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+        barrier.srcStageMask = previous.stage;
+        barrier.srcAccessMask = previous.write ? previous.access : 0; //reads leave nothing to make available
+        barrier.dstStageMask = next.stage;
+        barrier.dstAccessMask = next.access;
+        barrier.oldLayout = previous.layout;
+        barrier.newLayout = next.layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {deviceHandler->getImageStates().getAspect(image), mip, 1, baseLayer, layerCount};
+        pending.push_back(barrier);
+    }
+
+    //barriers of one call are not ordered among themselves, a second transition of a subresource needs a flush in between
+    void checkNotPending(VkImage image, uint32_t mip, uint32_t baseLayer, uint32_t endLayer, size_t firstNew){
+        for(size_t i = 0; i < firstNew; ++i){
+            VkImageMemoryBarrier2KHR& barrier = pending[i];
+            VkImageSubresourceRange& range = barrier.subresourceRange;
+            if(barrier.image != image) continue;
+
+            bool mipOverlaps = mip >= range.baseMipLevel && mip < range.baseMipLevel + range.levelCount;
+            bool layersOverlap = baseLayer < range.baseArrayLayer + range.layerCount && range.baseArrayLayer < endLayer;
+            if(mipOverlaps && layersOverlap) throw std::runtime_error("Image subresource transitioned twice without a flush in between.\n");
+        }
+    }
+
+    //one vkCmdPipelineBarrier with the stages of all barriers combined
+    void recordLegacy(VkCommandBuffer commandBuffer){
+        legacyBarriers.resize(pending.size());
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+
+        for(size_t i = 0; i < pending.size(); ++i){
+            VkImageMemoryBarrier2KHR& barrier = pending[i];
+            srcStages |= static_cast<VkPipelineStageFlags>(barrier.srcStageMask);
+            dstStages |= static_cast<VkPipelineStageFlags>(barrier.dstStageMask);
+
+            VkImageMemoryBarrier& legacy = legacyBarriers[i];
+            legacy = {};
+            legacy.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            legacy.srcAccessMask = static_cast<VkAccessFlags>(barrier.srcAccessMask);
+            legacy.dstAccessMask = static_cast<VkAccessFlags>(barrier.dstAccessMask);
+            legacy.oldLayout = barrier.oldLayout;
+            legacy.newLayout = barrier.newLayout;
+            legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+            legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+            legacy.image = barrier.image;
+            legacy.subresourceRange = barrier.subresourceRange;
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(legacyBarriers.size()), legacyBarriers.data());
+    }
+};
@@ -3,26 +3,36 @@
 #include <GLFW/glfw3.h>
 //vulkan.h is loaded above
 
+#include <cstring>
+
+#include "Globals.h"
 #include "DeviceHandler.h"
 #include "CommandBuffersHandler.h"
 
 namespace BufferHelpers {
     uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, DeviceHandler*& deviceHandler){
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(deviceHandler->getPhysicalDevice(), &memProperties);
+		return deviceHandler->getAllocator().findMemoryType(typeFilter, properties);
+	}
 
-		for(int32_t i = 0; i < memProperties.memoryTypeCount; ++i){
-			if((typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)) return i;
-		}
+    //host visible, coherent flags for buffers the cpu reads back from while filling them, cached when the device offers it
+    VkMemoryPropertyFlags GetHostReadableFlags(DeviceHandler*& deviceHandler){
+        return deviceHandler->getAllocator().getHostReadableFlags();
+    }
 
-		throw std::runtime_error("Failed to find suitable memory type.\n");
-	}
+    //accounting category of a buffer, going by what it is used for
+    MemoryCategory GetMemoryCategory(VkBufferUsageFlags usage){
+        if(usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) return MEMORY_CATEGORY_VERTEX;
+        if(usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) return MEMORY_CATEGORY_INDEX;
+        if(usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) return MEMORY_CATEGORY_UNIFORM;
+        if(usage & (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) return MEMORY_CATEGORY_STAGING; //uploads and readbacks
+        return MEMORY_CATEGORY_OTHER;
+    }
 
     void CreateBuffer(VkDeviceSize size,
                       VkBufferUsageFlags usage,
                       VkMemoryPropertyFlags properties,
                       VkBuffer& buffer,
-                      VkDeviceMemory& bufferMemory,
+                      MemoryAllocation& bufferAllocation,
                       DeviceHandler*& deviceHandler){
         VkBufferCreateInfo bufferInfo{};	
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -32,25 +42,77 @@ namespace BufferHelpers {
 
         if(vkCreateBuffer(deviceHandler->getLogicalDevice(), &bufferInfo, nullptr, &buffer) != VK_SUCCESS) throw std::runtime_error("Failed to create buffer.\n");
 
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(deviceHandler->getLogicalDevice(), buffer, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = BufferHelpers::FindMemoryType(memRequirements.memoryTypeBits, properties, deviceHandler);
-
-        if(vkAllocateMemory(deviceHandler->getLogicalDevice(), &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) throw std::runtime_error("Failed to allocate buffer memory.\n");
-        vkBindBufferMemory(deviceHandler->getLogicalDevice(), buffer, bufferMemory, 0);
+        bufferAllocation = deviceHandler->getAllocator().allocateForBuffer(buffer, properties, GetMemoryCategory(usage));
+        vkBindBufferMemory(deviceHandler->getLogicalDevice(), buffer, bufferAllocation.memory, bufferAllocation.offset);
     }
 
-    void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, CommandBuffersHandler*& buffersHandler) {
+    void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, CommandBuffersHandler*& buffersHandler, VkDeviceSize srcOffset = 0) {
         VkCommandBuffer commandBuffer = buffersHandler->beginSingleTimeCommands();
 
         VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = srcOffset;
         copyRegion.size = size;
         vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
         buffersHandler->endSingleTimeCommands(commandBuffer);
     }
+
+    //whether an upload of size bytes into a buffer allowed in typeFilter memory is better written straight into it than staged
+    //true for device local memory the cpu can map (resizable bar, or everything on integrated and cpu implementations) within the size policy
+    bool CanWriteDirectly(VkDeviceSize size, uint32_t typeFilter, DeviceHandler*& deviceHandler){
+        MemoryAllocator& allocator = deviceHandler->getAllocator();
+        const VkPhysicalDeviceMemoryProperties& memProperties = deviceHandler->getCapabilities().getMemoryProperties();
+        VkMemoryPropertyFlags direct = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+        if(!allocator.hasMemoryType(typeFilter, direct)) return false;
+
+        //unified memory: every device local type is mappable, staging would only copy host memory to host memory
+        bool unified = true;
+        for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i){
+            VkMemoryPropertyFlags flags = memProperties.memoryTypes[i].propertyFlags;
+            if((flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) unified = false;
+        }
+
+        return unified || size <= DIRECT_WRITE_MAX_SIZE; //a small bar window is better left to small, frequently written buffers
+    }
+
+    //creates a device local buffer holding size bytes of data, written through a mapping where CanWriteDirectly allows and staged otherwise
+    void CreateBufferWithData(const void* data,
+                              VkDeviceSize size,
+                              VkBufferUsageFlags usage,
+                              VkBuffer& buffer,
+                              MemoryAllocation& bufferAllocation,
+                              DeviceHandler*& deviceHandler,
+                              CommandBuffersHandler*& buffersHandler){
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if(vkCreateBuffer(deviceHandler->getLogicalDevice(), &bufferInfo, nullptr, &buffer) != VK_SUCCESS) throw std::runtime_error("Failed to create buffer.\n");
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(deviceHandler->getLogicalDevice(), buffer, &memRequirements);
+
+        if(CanWriteDirectly(size, memRequirements.memoryTypeBits, deviceHandler)){
+            bufferAllocation = deviceHandler->getAllocator().allocateForBuffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, GetMemoryCategory(usage));
+            vkBindBufferMemory(deviceHandler->getLogicalDevice(), buffer, bufferAllocation.memory, bufferAllocation.offset);
+
+            memcpy(bufferAllocation.mapped, data, static_cast<size_t>(size)); //coherent, and the next submit makes host writes visible to the device
+            return;
+        }
+
+        bufferAllocation = deviceHandler->getAllocator().allocateForBuffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GetMemoryCategory(usage));
+        vkBindBufferMemory(deviceHandler->getLogicalDevice(), buffer, bufferAllocation.memory, bufferAllocation.offset);
+
+        StagingRegion staging = buffersHandler->GetStagingRing().reserve(size);
+        memcpy(staging.mapped, data, static_cast<size_t>(size));
+        CopyBuffer(staging.buffer, buffer, size, buffersHandler, staging.offset);
+    }
+
+    void DestroyBuffer(VkBuffer buffer, MemoryAllocation& bufferAllocation, DeviceHandler*& deviceHandler){
+        vkDestroyBuffer(deviceHandler->getLogicalDevice(), buffer, nullptr);
+        deviceHandler->getAllocator().free(bufferAllocation);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,147 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <stdexcept>
+
+#include "Globals.h"
+#include "DeviceHandler.h"
+
+//keeps one recorded frame command buffer per (frame in flight, swapchain image) and submits it again as long as nothing it was recorded from changed
+//a static scene then only costs the uniform writes and a submit; whatever changes the recorded state has to invalidate it
+//every entry has a pool of its own, rerecording one resets only that pool: frames and images rarely pair up the same way twice in a row
+//(two frames in flight over three images is the common case), so a reset shared by a frame slot would throw away recordings before they are reused
+class CommandBufferCache{
+    struct Entry{
+        VkCommandPool commandPool = VK_NULL_HANDLE; //holds only commandBuffer, reset as a whole
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        bool valid = false;
+        uint64_t descriptorVersion = 0; //DescriptorSetsHandler::getVersion() when recorded, writes invalidate the sets bound in it
+        uint32_t dynamicOffset = 0; //the uniform offset bound in it
+    };
+
+    std::vector<Entry> entries; //[frame * imageCount + image]
+    uint32_t frameCount = 0;
+    uint32_t imageCount = 0;
+
+    uint64_t recordCount = 0;
+    uint64_t reuseCount = 0;
+
+    //debug check that unchanged frames really are reused: gets since the last invalidation or change of recorded state, and the reuse count when that began
+    uint64_t unchangedGets = 0;
+    uint64_t unchangedSinceReuse = 0;
+    uint64_t lastDescriptorVersion = 0;
+    uint32_t lastDynamicOffset = 0;
+
+    DeviceHandler* deviceHandler;
+
+public:
+    CommandBufferCache(DeviceHandler*& _dh, uint32_t _frameCount, uint32_t _imageCount) : deviceHandler(_dh){
+        resize(_frameCount, _imageCount);
+    }
+
+    ~CommandBufferCache(){
+        destroyCommandPools();
+    }
+
+    inline uint64_t getRecordCount(){ return recordCount; }
+    inline uint64_t getReuseCount(){ return reuseCount; }
+
+    //index of the (frame, image) pair, for per recording resources such as secondary command buffers
+    inline uint32_t getSlot(uint32_t frame, uint32_t image){ return frame * imageCount + image; }
+    inline uint32_t getSlotCount(){ return frameCount * imageCount; }
+
+    //the scene, swapchain or anything else recorded changed: every entry is recorded again the next time it is used
+    //entries of frames still executing are only marked, they are rerecorded once their slot comes round again
+    void invalidate(){
+        for(auto& entry : entries) entry.valid = false;
+        unchangedGets = 0;
+    }
+
+    //after the frames in flight or the swapchain image count changed; frames may still be executing, the old pools are retired
+    void resize(uint32_t _frameCount, uint32_t _imageCount){
+        invalidate();
+        if(_frameCount == frameCount && _imageCount == imageCount) return;
+
+        retireCommandPools();
+
+        frameCount = _frameCount;
+        imageCount = _imageCount;
+        entries.assign(getSlotCount(), Entry{});
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = 0; //no individual resets, the driver can keep the pool's memory in one piece
+        poolInfo.queueFamilyIndex = deviceHandler->getQueueFamilyIndices().graphicsFamily.value();
+
+        for(auto& entry : entries){
+            if(vkCreateCommandPool(deviceHandler->getLogicalDevice(), &poolInfo, nullptr, &entry.commandPool) != VK_SUCCESS) throw std::runtime_error("Failed to create frame command pool.\n");
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = entry.commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if(vkAllocateCommandBuffers(deviceHandler->getLogicalDevice(), &allocInfo, &entry.commandBuffer) != VK_SUCCESS) throw std::runtime_error("Could not allocate command buffers.\n");
+        }
+    }
+
+    //the command buffer to submit for frame and image, recorded by record only if the cached one is out of date or force is set
+    //record(commandBuffer) returns whether the recording may be submitted again, false if it holds one time work such as queue ownership acquires
+    //the frame that last used this frame and image must have finished
+    template<typename RecordFunction>
+    VkCommandBuffer get(uint32_t frame, uint32_t image, uint64_t descriptorVersion, uint32_t dynamicOffset, bool force, const RecordFunction& record){
+        Entry& entry = entries[getSlot(frame, image)];
+        if(DEBUG) checkReuse(descriptorVersion, dynamicOffset, force);
+
+        if(!force && entry.valid && entry.descriptorVersion == descriptorVersion && entry.dynamicOffset == dynamicOffset){
+            ++reuseCount;
+            return entry.commandBuffer;
+        }
+
+        vkResetCommandPool(deviceHandler->getLogicalDevice(), entry.commandPool, 0);
+
+        entry.valid = record(entry.commandBuffer);
+        entry.descriptorVersion = descriptorVersion;
+        entry.dynamicOffset = dynamicOffset;
+        ++recordCount;
+
+        return entry.commandBuffer;
+    }
+
+private:
+    //once every entry has been recorded with the same state and visited again, nothing may be recorded anymore
+    //without this a change that keeps entries from ever being reused, as a reset shared between entries did, only shows as a slower frame
+    void checkReuse(uint64_t descriptorVersion, uint32_t dynamicOffset, bool force){
+        if(force || descriptorVersion != lastDescriptorVersion || dynamicOffset != lastDynamicOffset){
+            lastDescriptorVersion = descriptorVersion;
+            lastDynamicOffset = dynamicOffset;
+            unchangedGets = 0;
+            return;
+        }
+
+        if(unchangedGets++ == 0) unchangedSinceReuse = reuseCount;
+        if(unchangedGets > 2ull * getSlotCount() && reuseCount == unchangedSinceReuse) throw std::runtime_error("Command buffer cache records every frame although nothing changed.\n");
+    }
+
+    //frames may still be executing the buffers of the old pools, destroying a pool frees its buffer
+    void retireCommandPools(){
+        if(entries.empty()) return;
+
+        DeviceHandler* dh = deviceHandler;
+        std::vector<Entry> retired;
+        retired.swap(entries);
+        dh->getDeletionQueue().retire([dh, retired](){
+            for(auto& entry : retired) vkDestroyCommandPool(dh->getLogicalDevice(), entry.commandPool, nullptr);
+        });
+    }
+
+    void destroyCommandPools(){
+        for(auto& entry : entries) vkDestroyCommandPool(deviceHandler->getLogicalDevice(), entry.commandPool, nullptr);
+        entries.clear();
+    }
+};
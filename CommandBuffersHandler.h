@@ -4,81 +4,281 @@
 //vulkan.h is loaded above
 
 #include <vector>
+#include <deque>
+#include <stdexcept>
 #include "DeviceHandler.h"
+#include "StagingRing.h"
 #include "Globals.h"
 
 class CommandBuffersHandler{
-	VkCommandPool commandPool;
-	std::vector<VkCommandBuffer> commandBuffers;
+	VkCommandPool commandPool; //transient, single time commands are allocated from it and recycled
+    VkCommandPool transferCommandPool; //the same as commandPool without a dedicated transfer family
+    std::vector<VkCommandBuffer> freeCommandBuffers; //finished single time command buffers of commandPool, begun again instead of allocating
+    std::vector<VkCommandBuffer> freeTransferCommandBuffers; //the same for transferCommandPool, unused without a dedicated transfer family
+    StagingRing* stagingRing; //uploads recorded into single time commands stage their data here
+
+    struct PendingUpload{
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        VkCommandPool pool;
+        uint64_t serial; //of every submit, for isUploadFinished
+
+        //transfer submits only, the graphics half of their ownership transfers
+        uint64_t ticket = 0;
+        std::vector<VkBufferMemoryBarrier> bufferAcquires;
+        std::vector<VkImageMemoryBarrier> imageAcquires;
+        VkPipelineStageFlags acquireStages = 0;
+    };
+    std::deque<PendingUpload> pendingUploads; //submitted single time and transfer commands, in submission order
+    std::vector<VkBufferMemoryBarrier> acquireBufferBarriers; //scratch for recordPendingAcquires, reused every frame
+    std::vector<VkImageMemoryBarrier> acquireImageBarriers;
+    VkCommandBuffer batchCommandBuffer = VK_NULL_HANDLE;
+
+    uint64_t nextUploadSerial = 1;
+    uint64_t nextTransferTicket = 1;
+    uint64_t acquiredTransferTicket = 0; //every transfer up to this one has been acquired by a graphics command buffer
 
     DeviceHandler* deviceHandler;
 public:
     CommandBuffersHandler(DeviceHandler*& _dh) : deviceHandler(_dh){
         createCommandPool();
-        createCommandBuffers();
+        createTransferCommandPool();
+        stagingRing = new StagingRing(deviceHandler, STAGING_RING_SIZE);
     }
 
     ~CommandBuffersHandler(){
+        for(auto& upload : pendingUploads){
+            vkWaitForFences(deviceHandler->getLogicalDevice(), 1, &upload.fence, VK_TRUE, UINT64_MAX);
+            vkDestroyFence(deviceHandler->getLogicalDevice(), upload.fence, nullptr);
+        }
+        delete stagingRing;
+        if(transferCommandPool != commandPool) vkDestroyCommandPool(deviceHandler->getLogicalDevice(), transferCommandPool, nullptr);
         vkDestroyCommandPool(deviceHandler->getLogicalDevice(), commandPool, nullptr); //command buffers automatically cleaned here too
     }
 
-    inline std::vector<VkCommandBuffer>& GetCommandBuffers(){ return commandBuffers; }
-    inline VkCommandPool& GetCommandPool(){ return commandPool; }
+    inline StagingRing& GetStagingRing(){ return *stagingRing; }
+
+    //while a batch is open every single time command is recorded into the batch's command buffer instead of being submitted on its own
+    //recorded work must not be waited on or its resources freed before the batch has been submitted and waited for
+    void beginUploadBatch(){
+        if(batchCommandBuffer != VK_NULL_HANDLE) throw std::runtime_error("An upload batch is already open.\n");
+        batchCommandBuffer = allocateSingleTimeCommands(commandPool);
+    }
+
+    inline bool isUploadBatchOpen(){ return batchCommandBuffer != VK_NULL_HANDLE; }
+
+    //submits everything recorded since beginUploadBatch at once, pass the fence to waitForUploads before using the results
+    VkFence submitUploadBatch(){
+        if(batchCommandBuffer == VK_NULL_HANDLE) throw std::runtime_error("No upload batch is open.\n");
+
+        VkCommandBuffer commandBuffer = batchCommandBuffer;
+        batchCommandBuffer = VK_NULL_HANDLE;
+        vkEndCommandBuffer(commandBuffer);
+        return submitSingleTimeCommands(commandBuffer);
+    }
+
+    void waitForUploads(VkFence fence){
+        vkWaitForFences(deviceHandler->getLogicalDevice(), 1, &fence, VK_TRUE, UINT64_MAX);
+        reclaimUploads();
+    }
+
+    //frees command buffers, fences and staging space of submits that have finished
+    //a transfer is kept until its acquire has been recorded, so fences are destroyed in the order the staging ring releases them
+    void reclaimUploads(){
+        stagingRing->reclaim();
+
+        while(!pendingUploads.empty() && pendingUploads.front().ticket <= acquiredTransferTicket && vkGetFenceStatus(deviceHandler->getLogicalDevice(), pendingUploads.front().fence) == VK_SUCCESS){
+            vkDestroyFence(deviceHandler->getLogicalDevice(), pendingUploads.front().fence, nullptr);
+            getFreeList(pendingUploads.front().pool).push_back(pendingUploads.front().commandBuffer); //reset when begun again
+            pendingUploads.pop_front();
+        }
+    }
+
+    //commands for the transfer queue: only copies, and no waiting for them
+    //data must be staged right before recording, an open upload batch would otherwise count the same staging space as its own
+    VkCommandBuffer beginTransferCommands(){
+        if(batchCommandBuffer != VK_NULL_HANDLE) throw std::runtime_error("Transfer commands cannot be recorded while an upload batch is open.\n");
+        return allocateSingleTimeCommands(transferCommandPool);
+    }
+
+    //submits on the transfer queue and returns a ticket, the resources written are usable by graphics once isTransferAcquired(ticket)
+    //the acquire barriers must match the release barriers recorded by the caller, see ReleaseToGraphics in the helpers; ignored without a dedicated transfer family
+    uint64_t submitTransferCommands(VkCommandBuffer commandBuffer, const std::vector<VkBufferMemoryBarrier>& bufferAcquires, const std::vector<VkImageMemoryBarrier>& imageAcquires, VkPipelineStageFlags acquireStages){
+        vkEndCommandBuffer(commandBuffer);
+
+        PendingUpload upload{};
+        upload.commandBuffer = commandBuffer;
+        upload.pool = transferCommandPool;
+        upload.serial = nextUploadSerial++;
+        upload.ticket = nextTransferTicket++;
+        if(deviceHandler->getQueueFamilyIndices().hasDedicatedTransfer()){
+            upload.bufferAcquires = bufferAcquires;
+            upload.imageAcquires = imageAcquires;
+            upload.acquireStages = acquireStages;
+        }
+        upload.fence = submit(deviceHandler->getTransferQueue(), commandBuffer);
+        pendingUploads.push_back(std::move(upload));
+
+        return pendingUploads.back().ticket;
+    }
+
+    inline bool isTransferAcquired(uint64_t ticket){ return ticket <= acquiredTransferTicket; }
+
+    //whether a finished transfer is waiting for recordPendingAcquires, a frame recorded earlier cannot be reused then
+    bool hasPendingAcquires(){
+        for(auto& upload : pendingUploads){
+            if(upload.ticket == 0 || upload.ticket <= acquiredTransferTicket) continue;
+            return vkGetFenceStatus(deviceHandler->getLogicalDevice(), upload.fence) == VK_SUCCESS; //acquired in submission order
+        }
+        return false;
+    }
+
+    //records the acquire half of every finished transfer into a graphics command buffer, call before anything in it uses streamed resources
+    //the host has seen the transfer's fence signal before this buffer is submitted, which orders the release before the acquire
+    //returns whether any barrier was recorded, such a command buffer must not be submitted twice
+    bool recordPendingAcquires(VkCommandBuffer commandBuffer){
+        acquireBufferBarriers.clear();
+        acquireImageBarriers.clear();
+        VkPipelineStageFlags stages = 0;
+
+        for(auto& upload : pendingUploads){
+            if(upload.ticket == 0) continue;
+            if(upload.ticket <= acquiredTransferTicket) continue;
+            if(vkGetFenceStatus(deviceHandler->getLogicalDevice(), upload.fence) != VK_SUCCESS) break; //acquired in submission order
+
+            acquireBufferBarriers.insert(acquireBufferBarriers.end(), upload.bufferAcquires.begin(), upload.bufferAcquires.end());
+            acquireImageBarriers.insert(acquireImageBarriers.end(), upload.imageAcquires.begin(), upload.imageAcquires.end());
+            stages |= upload.acquireStages;
+            acquiredTransferTicket = upload.ticket;
+        }
+
+        bool recorded = !acquireBufferBarriers.empty() || !acquireImageBarriers.empty();
+        if(recorded){
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, stages, 0,
+                0, nullptr,
+                static_cast<uint32_t>(acquireBufferBarriers.size()), acquireBufferBarriers.data(),
+                static_cast<uint32_t>(acquireImageBarriers.size()), acquireImageBarriers.data());
+        }
+
+        reclaimUploads();
+        return recorded;
+    }
 
     VkCommandBuffer beginSingleTimeCommands() {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commandPool;
-        allocInfo.commandBufferCount = 1;
+        if(batchCommandBuffer != VK_NULL_HANDLE) return batchCommandBuffer;
+        return allocateSingleTimeCommands(commandPool);
+    }
+
+    void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+        if(commandBuffer == batchCommandBuffer) return; //submitted with the rest of the batch
+
+        vkEndCommandBuffer(commandBuffer);
+        waitForUploads(submitSingleTimeCommands(commandBuffer));
+    }
+
+    //submits without waiting, for work done while frames are running; the results may be used once isUploadFinished(serial)
+    //graphics submits execute in order, so frames submitted afterwards already see the results on the gpu
+    uint64_t endSingleTimeCommandsAsync(VkCommandBuffer commandBuffer){
+        if(commandBuffer == batchCommandBuffer) throw std::runtime_error("Commands of an upload batch cannot be submitted on their own.\n");
+
+        vkEndCommandBuffer(commandBuffer);
+        submitSingleTimeCommands(commandBuffer);
+        return pendingUploads.back().serial;
+    }
+
+    //whether the submit with this serial has finished, reclaimed submits have
+    bool isUploadFinished(uint64_t serial){
+        for(auto& upload : pendingUploads){
+            if(upload.serial == serial) return vkGetFenceStatus(deviceHandler->getLogicalDevice(), upload.fence) == VK_SUCCESS;
+        }
+        return true;
+    }
+
+private:
+    inline std::vector<VkCommandBuffer>& getFreeList(VkCommandPool pool){ return pool == commandPool ? freeCommandBuffers : freeTransferCommandBuffers; }
+
+    //a recycled command buffer of pool if one has finished, a new one otherwise
+    VkCommandBuffer allocateSingleTimeCommands(VkCommandPool pool){
+        std::vector<VkCommandBuffer>& freeList = getFreeList(pool);
 
         VkCommandBuffer commandBuffer;
-        vkAllocateCommandBuffers(deviceHandler->getLogicalDevice(), &allocInfo, &commandBuffer);
+        if(!freeList.empty()){
+            commandBuffer = freeList.back();
+            freeList.pop_back();
+        }
+        else{
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandPool = pool;
+            allocInfo.commandBufferCount = 1;
+
+            if(vkAllocateCommandBuffers(deviceHandler->getLogicalDevice(), &allocInfo, &commandBuffer) != VK_SUCCESS) throw std::runtime_error("Could not allocate command buffers.\n");
+            freeList.reserve(freeList.capacity() + 1); //room for every buffer ever allocated, so reclaimUploads never grows the list during a frame
+        }
 
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        vkBeginCommandBuffer(commandBuffer, &beginInfo); //implicitly resets a recycled one
 
         return commandBuffer;
     }
 
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-        vkEndCommandBuffer(commandBuffer);
+    VkFence submitSingleTimeCommands(VkCommandBuffer commandBuffer){
+        PendingUpload upload{};
+        upload.commandBuffer = commandBuffer;
+        upload.pool = commandPool;
+        upload.serial = nextUploadSerial++;
+        upload.fence = submit(deviceHandler->getGraphicsQueue(), commandBuffer);
+        pendingUploads.push_back(upload);
+
+        return upload.fence;
+    }
 
+    VkFence submit(VkQueue queue, VkCommandBuffer commandBuffer){
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffer;
 
-        vkQueueSubmit(deviceHandler->getGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(deviceHandler->getGraphicsQueue());
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
-        vkFreeCommandBuffers(deviceHandler->getLogicalDevice(), commandPool, 1, &commandBuffer);
+        VkFence fence;
+        if(vkCreateFence(deviceHandler->getLogicalDevice(), &fenceInfo, nullptr, &fence) != VK_SUCCESS) throw std::runtime_error("Failed to create upload fence.\n");
+
+        vkQueueSubmit(queue, 1, &submitInfo, fence);
+        stagingRing->markSubmitted(fence); //whatever was staged since the last submit is read by this one
+
+        return fence;
     }
 
-private:
     void createCommandPool(){
         QueueFamilyIndices& queueFamilyIndices = deviceHandler->getQueueFamilyIndices();
 
         VkCommandPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; //command buffers rerecorded individually, rather than together (default)
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; //short lived, each one reset on its own when recycled
         poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
 
         if(vkCreateCommandPool(deviceHandler->getLogicalDevice(), &poolInfo, nullptr, &commandPool) != VK_SUCCESS) throw std::runtime_error("Failed to create command pool.\n");
     }
 
-    void createCommandBuffers(){
-		commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    void createTransferCommandPool(){
+        QueueFamilyIndices& queueFamilyIndices = deviceHandler->getQueueFamilyIndices();
+        if(!queueFamilyIndices.hasDedicatedTransfer()){
+            transferCommandPool = commandPool;
+            return;
+        }
 
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = commandPool;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; //only short lived, one time submits, recycled like commandPool's
+        poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily.value();
 
-		if(vkAllocateCommandBuffers(deviceHandler->getLogicalDevice(), &allocInfo, commandBuffers.data()) != VK_SUCCESS) throw std::runtime_error("Could not allocate command buffers.\n");
-	}
+        if(vkCreateCommandPool(deviceHandler->getLogicalDevice(), &poolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) throw std::runtime_error("Failed to create transfer command pool.\n");
+    }
 };
\ No newline at end of file
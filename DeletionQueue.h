@@ -0,0 +1,69 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "FrameTimeline.h"
+
+//destroys gpu objects once the last frame that could use them has finished, instead of waiting for the device to go idle
+//anything dropped mid run (streamed out textures, moved buffers, targets of an old swapchain) is retired here with the timeline value of its last use
+//only the main thread retires and collects, destroy functions run on it
+class DeletionQueue{
+    struct Entry{
+        uint64_t frame; //FrameTimeline value whose completion makes it safe to destroy
+        std::function<void()> destroy;
+    };
+
+    std::vector<Entry> entries; //in retirement order, frames do not have to be
+
+    FrameTimeline& frameTimeline;
+
+public:
+    DeletionQueue(FrameTimeline& _frameTimeline) : frameTimeline(_frameTimeline){
+
+    }
+
+    //flushes, so it goes while the device is idle and before anything the destroy functions use
+    ~DeletionQueue(){
+        flush();
+    }
+
+    inline size_t getPendingCount(){ return entries.size(); }
+
+    //for something the frame being recorded may still use, the common case, e.g. an image its descriptors pointed at until now
+    void retire(std::function<void()> destroy){
+        retire(frameTimeline.getCurrentFrame(), std::move(destroy));
+    }
+
+    //for something last used by frame, e.g. a submit that signalled that timeline value
+    void retire(uint64_t frame, std::function<void()> destroy){
+        entries.push_back({frame, std::move(destroy)});
+    }
+
+    //call once per frame, destroys everything whose frame has finished; the timeline is queried once, destroy functions must not retire
+    void collect(){
+        if(entries.empty()) return;
+
+        uint64_t completed = frameTimeline.getCompletedFrame();
+        size_t kept = 0;
+        for(size_t i = 0; i < entries.size(); ++i){
+            if(entries[i].frame <= completed) entries[i].destroy();
+            else{
+                if(kept != i) entries[kept] = std::move(entries[i]);
+                ++kept;
+            }
+        }
+        entries.resize(kept);
+    }
+
+    //destroys everything regardless of frames, only while the device is idle
+    void flush(){
+        for(auto& entry : entries) entry.destroy();
+        entries.clear();
+    }
+};
@@ -4,41 +4,173 @@
 #include <GLFW/glfw3.h>
 //vulkan.h is loaded above
 
-#include <array>
+#include <vector>
+#include <algorithm>
 
 #include "Globals.h"
 #include "UniformBuffers.h"
 #include "TextureHandler.h"
+#include "VirtualTextureHandler.h"
 
+//set 0 holds the dynamic uniform buffer and, outside of bindless mode, the textures; bindless mode adds set 1 with the texture table alone
+//the table needs an update after bind layout and pool, and those may not contain dynamic buffers
 class DescriptorSetsHandler {
     VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorPool descriptorPool;
 	std::vector<VkDescriptorSet> descriptorSets;
+    std::vector<VkDescriptorSetLayout> setLayouts; //of the pipeline layout, in set order
+
+    //bindless mode only, set 1: one table per frame in flight, an element swapped in place must not be read by a frame still executing
+    VkDescriptorSetLayout bindlessSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool bindlessPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> bindlessSets;
 
     VkDevice& logicalDevice;
     UniformBuffers* uniformBuffers;
+    VirtualTextureHandler* virtualTexture; //when set, binding 2 is its page table
+    std::vector<VkDescriptorImageInfo> textureInfos; //latest contents of every texture element, so sets created later match the others
+    uint64_t version = 0; //bumped by writes to set 0 and by reallocating sets, command buffers recorded with an older version bound sets that have changed since
+
+    //bindless mode: set 1 is an array of bindlessCapacity textures, registered and unregistered at runtime
+    struct ReleasedSlot{
+        uint32_t index;
+        uint32_t framesRemaining;
+    };
+
+    uint32_t bindlessCapacity = 0;
+    uint32_t nextBindlessSlot = 0; //slots below this have been handed out at least once
+    std::vector<uint32_t> freeBindlessSlots;
+    std::vector<ReleasedSlot> releasedBindlessSlots; //unregistered, but possibly still read by a frame in flight
 
 public:
 
-    DescriptorSetsHandler(VkDevice& _ld, UniformBuffers* _ub, TextureHandler*& _th) : logicalDevice(_ld), uniformBuffers(_ub){
+    //binding 1 samples whatever image is given: a single texture, a texture array or a virtual texture's page cache
+    DescriptorSetsHandler(VkDevice& _ld, UniformBuffers* _ub, VkImageView textureImageView, VkSampler textureSampler, VirtualTextureHandler* _vt = nullptr) : logicalDevice(_ld), uniformBuffers(_ub), virtualTexture(_vt){
+        textureInfos.push_back({textureSampler, textureImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
+
+        createDescriptorSetLayout();
+        createDescriptorPool();
+        createDescriptorSets(static_cast<uint32_t>(uniformBuffers->getBuffers().size()));
+    }
+
+    //bindless mode, the texture array starts out empty and is filled through registerTexture
+    DescriptorSetsHandler(VkDevice& _ld, UniformBuffers* _ub, uint32_t _bindlessCapacity) : logicalDevice(_ld), uniformBuffers(_ub), virtualTexture(nullptr), bindlessCapacity(_bindlessCapacity){
+        textureInfos.resize(bindlessCapacity); //a null view marks an element nothing is registered in
+        freeBindlessSlots.reserve(bindlessCapacity); //update hands released slots back during frames, the list never has to grow there
+
         createDescriptorSetLayout();
         createDescriptorPool();
-        createDescriptorSets(_th);
+        createDescriptorSets(static_cast<uint32_t>(uniformBuffers->getBuffers().size()));
     }
 
     ~DescriptorSetsHandler(){
         vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
         vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+        if(isBindless()){
+            vkDestroyDescriptorPool(logicalDevice, bindlessPool, nullptr);
+            vkDestroyDescriptorSetLayout(logicalDevice, bindlessSetLayout, nullptr);
+        }
     }
 
-    inline VkDescriptorSetLayout& getDescriptorSetLayout() { return descriptorSetLayout; }
-    inline std::vector<VkDescriptorSet> getDescriptorSets() { return descriptorSets; }
+    inline std::vector<VkDescriptorSetLayout>& getSetLayouts() { return setLayouts; }
+    inline std::vector<VkDescriptorSet>& getDescriptorSets() { return descriptorSets; }
+
+    //binds every set of frame, dynamicOffset is where the frame's ubo landed in its uniform arena
+    void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t frame, uint32_t dynamicOffset){
+        VkDescriptorSet sets[] = {descriptorSets[frame], isBindless() ? bindlessSets[frame] : VK_NULL_HANDLE};
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(setLayouts.size()), sets, 1, &dynamicOffset);
+    }
+
+    inline bool isBindless(){ return bindlessCapacity > 0; }
+    inline uint64_t getVersion(){ return version; }
+
+    //one set per frame in flight, after the uniform buffers have been resized to count and while no frame is executing
+    //new sets get the latest texture of every element, they were never bound to anything older
+    void setFrameCount(uint32_t count){
+        if(count < descriptorSets.size()){
+            vkFreeDescriptorSets(logicalDevice, descriptorPool, static_cast<uint32_t>(descriptorSets.size() - count), descriptorSets.data() + count);
+            descriptorSets.resize(count);
+            if(isBindless()){
+                vkFreeDescriptorSets(logicalDevice, bindlessPool, static_cast<uint32_t>(bindlessSets.size() - count), bindlessSets.data() + count);
+                bindlessSets.resize(count);
+            }
+        }
+        else if(count > descriptorSets.size()) createDescriptorSets(count);
+        ++version;
+
+        //nothing is executing now, no countdown has to run longer than the new count
+        for(auto& released : releasedBindlessSlots) released.framesRemaining = std::min(released.framesRemaining, count);
+    }
+
+    //writes a texture into a free element of the bindless array of every frame's set and returns its index
+    //elements no frame in flight reads may be written while those frames execute, so this never waits
+    uint32_t registerTexture(VkImageView textureImageView, VkSampler textureSampler){
+        if(!isBindless()) throw std::runtime_error("Textures can only be registered in bindless mode.\n");
+
+        uint32_t index;
+        if(!freeBindlessSlots.empty()){
+            index = freeBindlessSlots.back();
+            freeBindlessSlots.pop_back();
+        }
+        else if(nextBindlessSlot < bindlessCapacity) index = nextBindlessSlot++;
+        else throw std::runtime_error("Bindless texture table is full.\n");
+
+        for(size_t i = 0; i < descriptorSets.size(); ++i) updateTextureDescriptor(i, textureImageView, textureSampler, index);
+
+        return index;
+    }
+
+    //the element is left as is (the array is partially bound) and only handed out again once no frame in flight can read it
+    void unregisterTexture(uint32_t index){
+        ReleasedSlot released{};
+        released.index = index;
+        released.framesRemaining = static_cast<uint32_t>(descriptorSets.size());
+        releasedBindlessSlots.push_back(released);
+        textureInfos[index] = {};
+    }
+
+    //call once per frame after the frame that last used the current slot has finished
+    void update(){
+        for(auto it = releasedBindlessSlots.begin(); it != releasedBindlessSlots.end();){
+            if(--it->framesRemaining == 0){
+                freeBindlessSlots.push_back(it->index);
+                it = releasedBindlessSlots.erase(it);
+            }
+            else ++it;
+        }
+    }
+
+    //rebinds the sampler at binding 1 of one frame's set 0, or element arrayElement of its table in bindless mode
+    //outside of bindless mode the caller must make sure that frame is not in flight
+    void updateTextureDescriptor(size_t frame, VkImageView textureImageView, VkSampler textureSampler, uint32_t arrayElement = 0){
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = textureImageView;
+        imageInfo.sampler = textureSampler;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = isBindless() ? bindlessSets[frame] : descriptorSets[frame];
+        descriptorWrite.dstBinding = isBindless() ? 0 : 1;
+        descriptorWrite.dstArrayElement = arrayElement;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(logicalDevice, 1, &descriptorWrite, 0, nullptr);
+        textureInfos[arrayElement] = imageInfo;
+        if(!isBindless()) ++version; //table elements are updated after bind, recordings binding the table stay valid
+    }
+
+    inline void updateTextureDescriptor(size_t frame, TextureHandler* textureHandler, uint32_t arrayElement = 0){
+        updateTextureDescriptor(frame, textureHandler->getTextureImageView(), textureHandler->getTextureSampler(), arrayElement);
+    }
 
 private:
     void createDescriptorSetLayout(){
         VkDescriptorSetLayoutBinding uboLayoutBinding{};
         uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC; //the offset into the frame's uniform arena is given when binding
         uboLayoutBinding.descriptorCount = 1;
         uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
         uboLayoutBinding.pImmutableSamplers = nullptr; //optional
@@ -50,7 +182,18 @@ private:
         samplerLayoutBinding.pImmutableSamplers = nullptr;
         samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
+		std::vector<VkDescriptorSetLayoutBinding> bindings = {uboLayoutBinding};
+        if(!isBindless()) bindings.push_back(samplerLayoutBinding);
+
+        if(virtualTexture != nullptr){
+            VkDescriptorSetLayoutBinding pageTableLayoutBinding{};
+            pageTableLayoutBinding.binding = 2;
+            pageTableLayoutBinding.descriptorCount = 1;
+            pageTableLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            pageTableLayoutBinding.pImmutableSamplers = nullptr;
+            pageTableLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+            bindings.push_back(pageTableLayoutBinding);
+        }
 
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -58,64 +201,151 @@ private:
         layoutInfo.pBindings = bindings.data();
 
         if(vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) throw std::runtime_error("Failed to create descriptor set layout.\n");
+        setLayouts = {descriptorSetLayout};
+
+#ifdef ENABLE_BINDLESS_TEXTURES
+        if(!isBindless()) return;
+
+        //the table is written after binding, elements never registered are never read
+        VkDescriptorSetLayoutBinding tableLayoutBinding{};
+        tableLayoutBinding.binding = 0;
+        tableLayoutBinding.descriptorCount = bindlessCapacity;
+        tableLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        tableLayoutBinding.pImmutableSamplers = nullptr;
+        tableLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorBindingFlagsEXT tableFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        bindingFlagsInfo.bindingCount = 1;
+        bindingFlagsInfo.pBindingFlags = &tableFlags;
+
+        VkDescriptorSetLayoutCreateInfo tableLayoutInfo{};
+        tableLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        tableLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+        tableLayoutInfo.pNext = &bindingFlagsInfo;
+        tableLayoutInfo.bindingCount = 1;
+        tableLayoutInfo.pBindings = &tableLayoutBinding;
+
+        if(vkCreateDescriptorSetLayout(logicalDevice, &tableLayoutInfo, nullptr, &bindlessSetLayout) != VK_SUCCESS) throw std::runtime_error("Failed to create bindless descriptor set layout.\n");
+        setLayouts.push_back(bindlessSetLayout);
+#endif
     }
 
     void createDescriptorPool(){
-        std::array<VkDescriptorPoolSize, 2> poolSizes{};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        std::vector<VkDescriptorPoolSize> poolSizes(1);
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        poolSizes[0].descriptorCount = FRAMES_IN_FLIGHT_LIMIT;
+
+        uint32_t samplers = (isBindless() ? 0 : 1) + (virtualTexture != nullptr ? 1 : 0);
+        if(samplers > 0) poolSizes.push_back({VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, FRAMES_IN_FLIGHT_LIMIT * samplers});
 
+        //room for the largest frames in flight setting, sets are freed and allocated as it changes
         VkDescriptorPoolCreateInfo poolInfo{};
         poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
         poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
         poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+        poolInfo.maxSets = FRAMES_IN_FLIGHT_LIMIT;
 
 		if(vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) throw std::runtime_error("Failed to create descriptor pool.\n");
+
+#ifdef ENABLE_BINDLESS_TEXTURES
+        if(!isBindless()) return;
+
+        VkDescriptorPoolSize tableSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, FRAMES_IN_FLIGHT_LIMIT * bindlessCapacity};
+
+        VkDescriptorPoolCreateInfo tablePoolInfo{};
+        tablePoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        tablePoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT | VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        tablePoolInfo.poolSizeCount = 1;
+        tablePoolInfo.pPoolSizes = &tableSize;
+        tablePoolInfo.maxSets = FRAMES_IN_FLIGHT_LIMIT;
+
+        if(vkCreateDescriptorPool(logicalDevice, &tablePoolInfo, nullptr, &bindlessPool) != VK_SUCCESS) throw std::runtime_error("Failed to create bindless descriptor pool.\n");
+#endif
 	}
 
-    void createDescriptorSets(TextureHandler*& textureHandler){
-		std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+    //allocates and fills the sets of the frame slots from the current count up to count
+    void createDescriptorSets(uint32_t count){
+        size_t first = descriptorSets.size();
+		std::vector<VkDescriptorSetLayout> layouts(count - first, descriptorSetLayout);
 
 		VkDescriptorSetAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 		allocInfo.descriptorPool = descriptorPool;
-		allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+		allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
 		allocInfo.pSetLayouts = layouts.data();
 
-		descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-		if(vkAllocateDescriptorSets(logicalDevice, &allocInfo, descriptorSets.data()) != VK_SUCCESS) throw std::runtime_error("Failed to allocate descriptor sets.\n");
+		descriptorSets.resize(count);
+		if(vkAllocateDescriptorSets(logicalDevice, &allocInfo, descriptorSets.data() + first) != VK_SUCCESS) throw std::runtime_error("Failed to allocate descriptor sets.\n");
+
+        if(isBindless()){
+            std::vector<VkDescriptorSetLayout> tableLayouts(count - first, bindlessSetLayout);
+            allocInfo.descriptorPool = bindlessPool;
+            allocInfo.pSetLayouts = tableLayouts.data();
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            bindlessSets.resize(count);
+            if(vkAllocateDescriptorSets(logicalDevice, &allocInfo, bindlessSets.data() + first) != VK_SUCCESS) throw std::runtime_error("Failed to allocate bindless descriptor sets.\n");
+        }
+
+		for (size_t i = first; i < count; i++) {
             VkDescriptorBufferInfo bufferInfo{};
             bufferInfo.buffer = uniformBuffers->getBuffers()[i];
             bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
-
-            VkDescriptorImageInfo imageInfo{};
-            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageInfo.imageView = textureHandler->getTextureImageView();
-            imageInfo.sampler = textureHandler->getTextureSampler();
+            bufferInfo.range = sizeof(UniformBufferObject); //one slice, wherever the dynamic offset puts it
 
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+            std::vector<VkWriteDescriptorSet> descriptorWrites(isBindless() ? 1 : 2); //the bindless array only gets its registered elements
 
             descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             descriptorWrites[0].dstSet = descriptorSets[i];
             descriptorWrites[0].dstBinding = 0;
             descriptorWrites[0].dstArrayElement = 0;
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             descriptorWrites[0].descriptorCount = 1;
             descriptorWrites[0].pBufferInfo = &bufferInfo;
 
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = descriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &imageInfo;
+            if(!isBindless()){
+                descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[1].dstSet = descriptorSets[i];
+                descriptorWrites[1].dstBinding = 1;
+                descriptorWrites[1].dstArrayElement = 0;
+                descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                descriptorWrites[1].descriptorCount = 1;
+                descriptorWrites[1].pImageInfo = &textureInfos[0];
+            }
+            else{
+                for(uint32_t element = 0; element < nextBindlessSlot; ++element){
+                    if(textureInfos[element].imageView == VK_NULL_HANDLE) continue;
+
+                    VkWriteDescriptorSet textureWrite{};
+                    textureWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                    textureWrite.dstSet = bindlessSets[i];
+                    textureWrite.dstBinding = 0;
+                    textureWrite.dstArrayElement = element;
+                    textureWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                    textureWrite.descriptorCount = 1;
+                    textureWrite.pImageInfo = &textureInfos[element];
+                    descriptorWrites.push_back(textureWrite);
+                }
+            }
+
+            VkDescriptorImageInfo pageTableInfo{};
+            if(virtualTexture != nullptr){
+                pageTableInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                pageTableInfo.imageView = virtualTexture->getPageTableImageView();
+                pageTableInfo.sampler = virtualTexture->getPageTableSampler();
+
+                VkWriteDescriptorSet pageTableWrite{};
+                pageTableWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                pageTableWrite.dstSet = descriptorSets[i];
+                pageTableWrite.dstBinding = 2;
+                pageTableWrite.dstArrayElement = 0;
+                pageTableWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                pageTableWrite.descriptorCount = 1;
+                pageTableWrite.pImageInfo = &pageTableInfo;
+                descriptorWrites.push_back(pageTableWrite);
+            }
 
             vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
         }
@@ -0,0 +1,84 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+#include "VulkanDispatch.h"
+
+const uint32_t NO_MEMORY_TYPE = UINT32_MAX;
+
+//what resource creation needs to know about the physical device, queried once when it is picked
+//format properties and memory type choices are memoized, so helpers can ask as often as they like without going to the driver
+class DeviceCapabilities{
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceFeatures features;
+    VkPhysicalDeviceMemoryProperties memProperties;
+
+    std::unordered_map<VkFormat, VkFormatProperties> formatProperties; //element references stay valid as it grows
+    std::unordered_map<uint64_t, uint32_t> memoryTypes; //type filter << 32 | property flags -> first matching type, or NO_MEMORY_TYPE
+    std::mutex mutex;
+
+public:
+    DeviceCapabilities(VkPhysicalDevice _pd) : physicalDevice(_pd){
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+        //every format the renderer creates images or attachments in, anything else is queried the first time it is asked for
+        const VkFormat knownFormats[] = {
+            VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UINT, VK_FORMAT_B8G8R8A8_SRGB,
+            VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT
+        };
+        for(VkFormat format : knownFormats) vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties[format]);
+    }
+
+    inline const VkPhysicalDeviceProperties& getProperties(){ return properties; }
+    inline const VkPhysicalDeviceLimits& getLimits(){ return properties.limits; }
+    inline const VkPhysicalDeviceFeatures& getFeatures(){ return features; }
+    inline const VkPhysicalDeviceMemoryProperties& getMemoryProperties(){ return memProperties; }
+
+    const VkFormatProperties& getFormatProperties(VkFormat format){
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = formatProperties.find(format);
+        if(it != formatProperties.end()) return it->second;
+
+        VkFormatProperties& props = formatProperties[format];
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+        return props;
+    }
+
+    bool supportsFormatFeatures(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags wanted){
+        const VkFormatProperties& props = getFormatProperties(format);
+        VkFormatFeatureFlags supported = tiling == VK_IMAGE_TILING_LINEAR ? props.linearTilingFeatures : props.optimalTilingFeatures;
+        return (supported & wanted) == wanted;
+    }
+
+    //first memory type allowed by typeFilter that has all the properties, NO_MEMORY_TYPE if there is none
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags flags){
+        uint64_t key = static_cast<uint64_t>(typeFilter) << 32 | flags;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = memoryTypes.find(key);
+        if(it != memoryTypes.end()) return it->second;
+
+        uint32_t memoryType = NO_MEMORY_TYPE;
+        for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i){
+            if((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & flags) == flags){
+                memoryType = i;
+                break;
+            }
+        }
+
+        memoryTypes[key] = memoryType;
+        return memoryType;
+    }
+};
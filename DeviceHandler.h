@@ -7,8 +7,18 @@
 #include <set>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <iostream>
 
+#include "Globals.h"
+#include "VulkanDispatch.h"
 #include "InstanceHandler.h"
+#include "DeviceCapabilities.h"
+#include "MemoryAllocator.h"
+#include "TransientAttachmentPool.h"
+#include "FrameTimeline.h"
+#include "ImageStateTracker.h"
+#include "DeletionQueue.h"
 #include "SurfaceHandler.h"
 #include "QueueFamilyIndices.h"
 #include "SwapchainSupportDetails.h"
@@ -17,14 +27,28 @@ class DeviceHandler{
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
 	VkDevice logicalDevice;
 
+    DeviceCapabilities* capabilities; //snapshot of the picked physical device, helpers read it instead of querying the driver
+    MemoryAllocator* allocator;
+    TransientAttachmentPool* transientAttachments;
+    FrameTimeline* frameTimeline;
+    ImageStateTracker* imageStates;
+    DeletionQueue* deletionQueue; //retired objects, destroyed once their frame finished
+
     QueueFamilyIndices* queueFamilyIndices;
     SwapchainSupportDetails* swapchainSupport;
 
     VkQueue graphicsQueue;
 	VkQueue presentQueue;
+    VkQueue transferQueue;
+
+    bool memoryBudgetSupported = false; //VK_EXT_memory_budget, enabled when available
+    bool synchronization2Supported = false; //VK_KHR_synchronization2, barriers fall back to vkCmdPipelineBarrier without it
 
     const std::vector<const char*> deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
+        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+#ifdef ENABLE_BINDLESS_TEXTURES
+        VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+#endif
     };
 
 public:
@@ -34,8 +58,41 @@ public:
     inline QueueFamilyIndices& getQueueFamilyIndices(){ return *queueFamilyIndices; }
     inline SwapchainSupportDetails& getSwapchainSupportDetails(){ return *swapchainSupport; }
 
+    inline DeviceCapabilities& getCapabilities(){ return *capabilities; }
+    inline MemoryAllocator& getAllocator(){ return *allocator; }
+    inline TransientAttachmentPool& getTransientAttachments(){ return *transientAttachments; }
+    inline FrameTimeline& getFrameTimeline(){ return *frameTimeline; }
+    inline ImageStateTracker& getImageStates(){ return *imageStates; }
+    inline DeletionQueue& getDeletionQueue(){ return *deletionQueue; }
+    inline bool isMemoryBudgetSupported(){ return memoryBudgetSupported; }
+    inline bool isSynchronization2Supported(){ return synchronization2Supported; }
+
+    //usage and budget of every heap as of now, written over heaps; without VK_EXT_memory_budget usage is what the allocator took and the budget is most of the heap
+    void getHeapBudgets(std::vector<HeapBudget>& heaps){
+        const VkPhysicalDeviceMemoryProperties& memProperties = allocator->getMemoryProperties();
+        heaps.resize(memProperties.memoryHeapCount); //allocates only the first time
+
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        if(memoryBudgetSupported){
+            VkPhysicalDeviceMemoryProperties2 properties{};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            properties.pNext = &budgetProperties;
+            vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+        }
+
+        for(uint32_t i = 0; i < memProperties.memoryHeapCount; ++i){
+            heaps[i].size = memProperties.memoryHeaps[i].size;
+            heaps[i].flags = memProperties.memoryHeaps[i].flags;
+            heaps[i].budget = memoryBudgetSupported ? budgetProperties.heapBudget[i] : heaps[i].size / 10 * 8;
+            heaps[i].usage = memoryBudgetSupported ? budgetProperties.heapUsage[i] : allocator->getAllocatedBytes(i);
+        }
+    }
+
     inline VkQueue& getGraphicsQueue(){ return graphicsQueue; }
     inline VkQueue& getPresentQueue(){ return presentQueue; }
+    inline VkQueue& getTransferQueue(){ return transferQueue; }
 
     SwapchainSupportDetails& UpdateSwapchainSupportDetails(){
         swapchainSupport->Update(physicalDevice);
@@ -44,11 +101,23 @@ public:
 
     DeviceHandler(InstanceHandler* instanceHandler, SurfaceHandler* surfaceHandler, const std::vector<const char*>& validationLayers){
         pickPhysicalDevice(instanceHandler, surfaceHandler);
+        capabilities = new DeviceCapabilities(physicalDevice);
         createLogicalDevice(validationLayers);
+        allocator = new MemoryAllocator(*capabilities, logicalDevice);
+        transientAttachments = new TransientAttachmentPool(logicalDevice, allocator);
+        frameTimeline = new FrameTimeline(logicalDevice);
+        imageStates = new ImageStateTracker();
+        deletionQueue = new DeletionQueue(*frameTimeline);
     }
 
     ~DeviceHandler(){
+        delete deletionQueue; //destroys whatever is still retired, it may use everything below
+        delete imageStates;
+        delete frameTimeline;
+        delete transientAttachments;
+        delete allocator; //every block goes back before the device does
         vkDestroyDevice(logicalDevice, nullptr); //physical dev. handler is implicitly deleted, no need to do anything
+        delete capabilities;
         delete queueFamilyIndices;
         delete swapchainSupport;
     }
@@ -92,6 +161,12 @@ private:
 		SwapchainSupportDetails support(device, surfaceHandler);
 		swapchainAdequate = !support.formats.empty() && !support.presentModes.empty();
 
+		if(deviceProperties.apiVersion < VK_API_VERSION_1_2 || !checkTimelineSemaphoreSupport(device)) return false;
+
+#ifdef ENABLE_BINDLESS_TEXTURES
+		if(!deviceFeatures.shaderSampledImageArrayDynamicIndexing || !checkDescriptorIndexingSupport(device)) return false;
+#endif
+
 		if(indices.isComplete() && allExtensionsSupported && swapchainAdequate && deviceFeatures.samplerAnisotropy){
             queueFamilyIndices = new QueueFamilyIndices(indices);
             swapchainSupport = new SwapchainSupportDetails(support);
@@ -115,12 +190,82 @@ private:
 		return requiredExtensions.empty();
 	}
 
+	bool isExtensionAvailable(VkPhysicalDevice device, const char* name){
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+		for(const auto& e : availableExtensions){
+			if(strcmp(e.extensionName, name) == 0) return true;
+		}
+		return false;
+	}
+
+	//frames are paced on a timeline semaphore, see FrameTimeline
+	bool checkTimelineSemaphoreSupport(VkPhysicalDevice device){
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &timelineFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		return timelineFeatures.timelineSemaphore;
+	}
+
+	//optional, see BarrierBatcher
+	bool checkSynchronization2Support(VkPhysicalDevice device){
+		VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features{};
+		synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &synchronization2Features;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		return synchronization2Features.synchronization2;
+	}
+
+#ifdef ENABLE_BINDLESS_TEXTURES
+	//the bindless table is a partially bound array written while frames using other elements of it are in flight
+	bool checkDescriptorIndexingSupport(VkPhysicalDevice device){
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &indexingFeatures;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{};
+		indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &indexingProperties;
+		vkGetPhysicalDeviceProperties2(device, &properties);
+
+		return indexingFeatures.runtimeDescriptorArray
+			&& indexingFeatures.descriptorBindingPartiallyBound
+			&& indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+			&& indexingFeatures.descriptorBindingUpdateUnusedWhilePending
+			&& indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages >= BINDLESS_TEXTURE_CAPACITY
+			&& indexingProperties.maxDescriptorSetUpdateAfterBindSamplers >= BINDLESS_TEXTURE_CAPACITY
+			&& indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages >= BINDLESS_TEXTURE_CAPACITY
+			&& indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers >= BINDLESS_TEXTURE_CAPACITY;
+	}
+#endif
+
     void createLogicalDevice(const std::vector<const char*>& validationLayers){
         //queues to be created
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
 		std::set<uint32_t> uniqueQueueFamilies = {
 			queueFamilyIndices->graphicsFamily.value(),
-			queueFamilyIndices->presentFamily.value()
+			queueFamilyIndices->presentFamily.value(),
+			queueFamilyIndices->transferFamily.value()
 		};
 
 		float queuePriority = 1.0f;
@@ -141,12 +286,44 @@ private:
 		//creating the logical device
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		timelineFeatures.timelineSemaphore = VK_TRUE;
+		createInfo.pNext = &timelineFeatures;
+
+#ifdef ENABLE_BINDLESS_TEXTURES
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+		indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+		indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		timelineFeatures.pNext = &indexingFeatures;
+#endif
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 
+		//optional extensions go on top of the required ones
+		std::vector<const char*> enabledExtensions = deviceExtensions;
+		memoryBudgetSupported = isExtensionAvailable(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if(memoryBudgetSupported) enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+		VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features{};
+		synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+		synchronization2Supported = isExtensionAvailable(physicalDevice, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME) && checkSynchronization2Support(physicalDevice);
+		if(synchronization2Supported){
+			enabledExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+			synchronization2Features.synchronization2 = VK_TRUE;
+			synchronization2Features.pNext = const_cast<void*>(createInfo.pNext);
+			createInfo.pNext = &synchronization2Features;
+		}
+
 		createInfo.pEnabledFeatures = &deviceFeatures;
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 		//not needed anymore, but req. for older implementations
 		if(enableValidationLayers){
@@ -157,9 +334,13 @@ private:
 		}
 		
 		if(vkCreateDevice(physicalDevice, &createInfo, nullptr, &logicalDevice) != VK_SUCCESS) throw std::runtime_error("Failed to create logical device\n");
+		VulkanDispatch::LoadDeviceCommands(logicalDevice); //every device command from here on goes straight to the driver
 
 		//get a handle to the created queues
 		vkGetDeviceQueue(logicalDevice, queueFamilyIndices->graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(logicalDevice, queueFamilyIndices->presentFamily.value(), 0, &presentQueue);
+		vkGetDeviceQueue(logicalDevice, queueFamilyIndices->transferFamily.value(), 0, &transferQueue);
+
+		if(DEBUG) std::cout << "Barriers: " << (synchronization2Supported ? "vkCmdPipelineBarrier2KHR" : "vkCmdPipelineBarrier") << '\n';
     }
 };
\ No newline at end of file
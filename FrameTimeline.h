@@ -0,0 +1,81 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <stdexcept>
+#include <cstdint>
+
+#include "Globals.h"
+#include "VulkanDispatch.h"
+
+//one timeline semaphore counting frames: the submit of frame N signals value N once all of its work is done
+//waiting on a frame, and asking whether one has finished, works the same for every subsystem without fences to reset
+class FrameTimeline{
+    VkSemaphore semaphore;
+    uint64_t submittedFrame = 0; //value the latest submit signals, 0 before the first
+    uint64_t completedFrame = 0; //last value seen signalled, only ever refreshed when a query needs more
+    uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT; //frames submitted but possibly unfinished while the next is recorded
+
+    VkDevice& logicalDevice;
+
+public:
+    FrameTimeline(VkDevice& _ld) : logicalDevice(_ld){
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if(vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) throw std::runtime_error("Failed to create frame timeline semaphore.\n");
+    }
+
+    ~FrameTimeline(){
+        vkDestroySemaphore(logicalDevice, semaphore, nullptr);
+    }
+
+    inline VkSemaphore getSemaphore(){ return semaphore; }
+
+    //every per frame resource array has this many slots, see Renderer::setFramesInFlight for changing it
+    inline uint32_t getFramesInFlight(){ return framesInFlight; }
+    inline void setFramesInFlight(uint32_t count){ framesInFlight = count; }
+
+    //the frame being recorded now, its submit signals this value
+    inline uint64_t getCurrentFrame(){ return submittedFrame + 1; }
+    inline uint64_t getSubmittedFrame(){ return submittedFrame; }
+
+    //to be called right after the submit signalling getCurrentFrame() went out
+    inline void markSubmitted(){ ++submittedFrame; }
+
+    bool isFrameComplete(uint64_t frame){
+        if(frame <= completedFrame) return true;
+        if(frame > submittedFrame) return false; //nothing signals it yet
+
+        vkGetSemaphoreCounterValue(logicalDevice, semaphore, &completedFrame);
+        return frame <= completedFrame;
+    }
+
+    uint64_t getCompletedFrame(){
+        vkGetSemaphoreCounterValue(logicalDevice, semaphore, &completedFrame);
+        return completedFrame;
+    }
+
+    //blocks until frame has finished on the gpu, frames never submitted count as finished
+    void waitForFrame(uint64_t frame){
+        if(frame > submittedFrame) frame = submittedFrame;
+        if(frame <= completedFrame) return;
+
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &semaphore;
+        waitInfo.pValues = &frame;
+
+        if(vkWaitSemaphores(logicalDevice, &waitInfo, UINT64_MAX) != VK_SUCCESS) throw std::runtime_error("Failed to wait for frame timeline.\n");
+        completedFrame = frame;
+    }
+};
@@ -1,9 +1,44 @@
 #pragma once
-#define MAX_FRAMES_IN_FLIGHT 2
 #define DEBUG 1
 
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2; //frames the cpu may run ahead of the gpu at startup
+const uint32_t FRAMES_IN_FLIGHT_LIMIT = 3; //largest frames in flight setting, F cycles through 1 .. this at runtime
+
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 const char* MODEL_PATH = "models/viking_room.obj";
-const char* TEXTURE_PATH = "textures/viking_room.png";
\ No newline at end of file
+const char* TEXTURE_PATH = "textures/viking_room.png";
+
+//#define ENABLE_TEXTURE_ARRAYS //pack textures into one 2D array image sampled through a per draw texture slot, needs shaders/frag_array.spv from compile.sh
+const uint32_t TEXTURE_ARRAY_LAYER_SIZE = 1024; //texels per side of every texture array layer
+
+//#define ENABLE_BINDLESS_TEXTURES //register textures in one large descriptor array indexed through the per draw texture slot, needs VK_EXT_descriptor_indexing and shaders/frag_bindless.spv from compile.sh
+const uint32_t BINDLESS_TEXTURE_CAPACITY = 4096; //descriptors in the bindless texture table
+
+const uint64_t MEMORY_BLOCK_SIZE = 64ull * 1024 * 1024; //bytes per device memory block buffers and images are sub-allocated from, must be a power of two
+
+const uint64_t UNIFORM_ARENA_SIZE = 1024 * 1024; //bytes of uniform data each frame in flight can hand out, reset every frame
+
+const uint64_t DIRECT_WRITE_MAX_SIZE = 16ull * 1024 * 1024; //largest upload written straight into mappable device local memory instead of staged, unless all of it is mappable
+
+const uint64_t STAGING_RING_SIZE = 32ull * 1024 * 1024; //bytes of the persistently mapped buffer uploads are staged through, larger uploads get a buffer of their own
+
+const uint32_t MEMORY_BUDGET_CHECK_INTERVAL = 60; //frames between checks of the heaps against their budgets
+const uint32_t MEMORY_REPORT_INTERVAL = 600; //frames between memory reports in debug builds
+
+const uint32_t DRAWS_PER_RECORDING_THREAD = 256; //draws a recording thread should get at least before another one is brought in, each thread records a secondary command buffer
+
+const uint32_t DEFRAG_FRAME_BUDGET_US = 1000; //microseconds per frame the defragmenter may spend recording moves, at least one move is made once it starts
+const uint64_t DEFRAG_FRAME_BYTES = 16ull * 1024 * 1024; //bytes the defragmenter may copy per frame, the copies run on the graphics queue ahead of the frame
+const float DEFRAG_MAX_BLOCK_USAGE = 0.5f; //memory blocks at most this full are emptied into the others
+const uint32_t DEFRAG_CHECK_INTERVAL = 120; //frames between looks for a block worth emptying while the defragmenter is idle
+
+const uint64_t TEXTURE_MEMORY_BUDGET = 256ull * 1024 * 1024; //bytes of texture memory the residency manager keeps textures under
+
+//#define ENABLE_VIRTUAL_TEXTURING //sample the model's texture through a page table instead, needs shaders/frag_vt.spv and shaders/vt_feedback.spv from compile.sh
+const char* VIRTUAL_TEXTURE_PATH = "textures/viking_room.vt"; //tiled texture file, baked from TEXTURE_PATH on first run if missing
+const uint32_t VT_PAGE_SIZE = 128; //texels per side of a page, must match PAGE_SIZE in the shaders
+const uint32_t VT_CACHE_PAGES = 8; //pages per side of the physical page cache texture
+const uint32_t VT_FEEDBACK_DIVISOR = 8; //the feedback pass renders at the swapchain resolution divided by this, log2 of it must match FEEDBACK_LOD_BIAS in vt_feedback.frag
+const uint32_t VT_MAX_UPLOADS_PER_FRAME = 8; //pages copied into the cache per frame at most
\ No newline at end of file
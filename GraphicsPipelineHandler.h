@@ -9,6 +9,7 @@
 #include "SwapchainHandler.h"
 #include "ShaderHandler.h"
 #include "Vertex.h"
+#include "TextureSlot.h"
 
 class GraphicsPipelineHandler{
 	VkPipelineLayout pipelineLayout;
@@ -18,8 +19,8 @@ class GraphicsPipelineHandler{
     SwapchainHandler* swapchainHandler;
 
 public:
-    GraphicsPipelineHandler(VkDevice& _ld, SwapchainHandler* _sh,  VkDescriptorSetLayout& descriptorSetLayout, VkRenderPass& renderPass) : logicalDevice(_ld), swapchainHandler(_sh){
-        createGraphicsPipeline(descriptorSetLayout, renderPass);
+    GraphicsPipelineHandler(VkDevice& _ld, SwapchainHandler* _sh, const std::vector<VkDescriptorSetLayout>& setLayouts, VkRenderPass& renderPass, const char* vertShaderPath = "shaders/vert.spv", const char* fragShaderPath = "shaders/frag.spv") : logicalDevice(_ld), swapchainHandler(_sh){
+        createGraphicsPipeline(setLayouts, renderPass, vertShaderPath, fragShaderPath);
     }
 
     ~GraphicsPipelineHandler(){
@@ -32,9 +33,9 @@ public:
 
 private:
     
-    void createGraphicsPipeline( VkDescriptorSetLayout& descriptorSetLayout, VkRenderPass& renderPass){
+    void createGraphicsPipeline(const std::vector<VkDescriptorSetLayout>& setLayouts, VkRenderPass& renderPass, const char* vertShaderPath, const char* fragShaderPath){
         //shaders are only needed at graphics pipeline creation time, so they are destroyed at the end of scope
-        ShaderHandler shaderHandler("shaders/vert.spv", "shaders/frag.spv", logicalDevice);
+        ShaderHandler shaderHandler(vertShaderPath, fragShaderPath, logicalDevice);
 
         VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
         vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -154,13 +155,19 @@ private:
         colorBlending.blendConstants[2] = 0.0f;
         colorBlending.blendConstants[3] = 0.0f;
 
+        //per draw texture slot, only read by shaders sampling a texture array
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(TextureSlot);
+
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         //optional
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
-        pipelineLayoutInfo.pPushConstantRanges = nullptr;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
         if(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) throw std::runtime_error("Failed to create pipeline layout.\n");
         
@@ -3,21 +3,32 @@
 #include <GLFW/glfw3.h>
 //vulkan.h is loaded above
 
+#include <vector>
+#include <algorithm>
+
 #include "DeviceHandler.h"
 #include "BufferHelpers.h"
+#include "BarrierBatcher.h"
 
 namespace ImageHelpers {
-    void CreateImage(
+    //accounting category of an image, going by what it is used for
+    MemoryCategory GetMemoryCategory(VkImageUsageFlags usage){
+        if(usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) return MEMORY_CATEGORY_DEPTH;
+        if(usage & VK_IMAGE_USAGE_SAMPLED_BIT) return MEMORY_CATEGORY_TEXTURE;
+        return MEMORY_CATEGORY_OTHER; //other render targets
+    }
+
+    //an image with no memory bound yet, for callers that allocate it themselves
+    void CreateUnboundImage(
         uint32_t width,
         uint32_t height,
         uint32_t mipLevels,
         VkFormat format,
         VkImageTiling tiling,
         VkImageUsageFlags usage,
-        VkMemoryPropertyFlags properties,
         VkImage& image,
-        VkDeviceMemory& imageMemory,
-        DeviceHandler*& deviceHandler
+        DeviceHandler*& deviceHandler,
+        uint32_t arrayLayers = 1
     ){
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -26,7 +37,7 @@ namespace ImageHelpers {
         imageInfo.extent.height = height;
         imageInfo.extent.depth = 1;
         imageInfo.mipLevels = mipLevels;
-        imageInfo.arrayLayers = 1;
+        imageInfo.arrayLayers = arrayLayers;
         imageInfo.format = format;
         imageInfo.tiling = tiling;
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -36,30 +47,51 @@ namespace ImageHelpers {
         imageInfo.flags = 0; //optional
 
         if(vkCreateImage(deviceHandler->getLogicalDevice(), &imageInfo, nullptr, &image) != VK_SUCCESS) throw std::runtime_error("Failed to create VkImage.\n");
+        deviceHandler->getImageStates().track(image, mipLevels, arrayLayers, usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT);
+    }
 
-        VkMemoryRequirements memReq;
-        vkGetImageMemoryRequirements(deviceHandler->getLogicalDevice(), image, &memReq);
+    //for images from CreateUnboundImage that never got memory
+    void DestroyUnboundImage(VkImage image, DeviceHandler*& deviceHandler){
+        deviceHandler->getImageStates().untrack(image);
+        vkDestroyImage(deviceHandler->getLogicalDevice(), image, nullptr);
+    }
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReq.size;
-        allocInfo.memoryTypeIndex = BufferHelpers::FindMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, deviceHandler);
+    void CreateImage(
+        uint32_t width,
+        uint32_t height,
+        uint32_t mipLevels,
+        VkFormat format,
+        VkImageTiling tiling,
+        VkImageUsageFlags usage,
+        VkMemoryPropertyFlags properties,
+        VkImage& image,
+        MemoryAllocation& imageAllocation,
+        DeviceHandler*& deviceHandler,
+        uint32_t arrayLayers = 1
+    ){
+        CreateUnboundImage(width, height, mipLevels, format, tiling, usage, image, deviceHandler, arrayLayers);
 
-        if(vkAllocateMemory(deviceHandler->getLogicalDevice(), &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) throw std::runtime_error("Failed to allocate image memory!\n");
-        vkBindImageMemory(deviceHandler->getLogicalDevice(), image, imageMemory, 0);
+        imageAllocation = deviceHandler->getAllocator().allocateForImage(image, properties, tiling, GetMemoryCategory(usage));
+        vkBindImageMemory(deviceHandler->getLogicalDevice(), image, imageAllocation.memory, imageAllocation.offset);
     }
 
-    VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, VkDevice& logicalDevice) {
+    void DestroyImage(VkImage image, MemoryAllocation& imageAllocation, DeviceHandler*& deviceHandler){
+        deviceHandler->getImageStates().untrack(image);
+        vkDestroyImage(deviceHandler->getLogicalDevice(), image, nullptr);
+        deviceHandler->getAllocator().free(imageAllocation);
+    }
+
+    VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, VkDevice& logicalDevice, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, uint32_t layerCount = 1) {
         VkImageViewCreateInfo viewInfo{};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         viewInfo.image = image;
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.viewType = viewType;
         viewInfo.format = format;
         viewInfo.subresourceRange.aspectMask = aspectFlags;
         viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.levelCount = mipLevels;
         viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = mipLevels;
+        viewInfo.subresourceRange.layerCount = layerCount;
 
         VkImageView imageView;
         if (vkCreateImageView(logicalDevice, &viewInfo, nullptr, &imageView) != VK_SUCCESS) throw std::runtime_error("failed to create image view!");
@@ -67,50 +99,133 @@ namespace ImageHelpers {
         return imageView;
     }
 
-    void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels,CommandBuffersHandler*& commandBuffersHandler) {
-        VkCommandBuffer commandBuffer = commandBuffersHandler->beginSingleTimeCommands();
+    //records a single transition of a tracked image into commandBuffer, masks and layouts follow from its tracked state
+    //several transitions at one point in a command buffer should share a BarrierBatcher instead, so they go out in one call
+    void TransitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, ImageAccess access, DeviceHandler*& deviceHandler, uint32_t baseMip = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS){
+        BarrierBatcher barriers(deviceHandler);
+        barriers.transition(image, access, baseMip, levelCount);
+        barriers.flush(commandBuffer);
+    }
+
+    //records the transfer queue half of handing image over to graphics, moving it from TRANSFER_DST_OPTIMAL to newLayout, and returns the matching acquire barrier
+    //without a dedicated transfer family this is an ordinary barrier and the acquire is ignored
+    VkImageMemoryBarrier ReleaseToGraphics(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout newLayout, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages, uint32_t mipLevels, DeviceHandler*& deviceHandler, uint32_t layerCount = 1){
+        QueueFamilyIndices& indices = deviceHandler->getQueueFamilyIndices();
+        bool dedicated = indices.hasDedicatedTransfer();
 
         VkImageMemoryBarrier barrier{};
         barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.oldLayout = oldLayout;
-        barrier.newLayout = newLayout;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = newLayout; //release and acquire must agree, the transition happens once between them
+        barrier.srcQueueFamilyIndex = dedicated ? indices.transferFamily.value() : VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = dedicated ? indices.graphicsFamily.value() : VK_QUEUE_FAMILY_IGNORED;
         barrier.image = image;
         barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         barrier.subresourceRange.baseMipLevel = 0;
         barrier.subresourceRange.levelCount = mipLevels;
         barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-
-        VkPipelineStageFlags sourceStage;
-        VkPipelineStageFlags destinationStage;
-
-        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-            barrier.srcAccessMask = 0;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        } 
-        else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-            sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-        } 
-        else throw std::invalid_argument("unsupported layout transition!");
-        
-        vkCmdPipelineBarrier(
-            commandBuffer,
-            sourceStage, destinationStage,
-            0,
+        barrier.subresourceRange.layerCount = layerCount;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dedicated ? 0 : dstAccess;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : dstStages, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        return barrier;
+    }
+
+    //fills an image from a buffer on the transfer queue without waiting, leaving it in SHADER_READ_ONLY_OPTIMAL once the returned ticket is acquired
+    //the buffer holds its levels tightly packed one after another from bufferOffset; transfer queues cannot blit, so the levels must all be given
+    uint64_t CopyBufferToImageAsync(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, DeviceHandler*& deviceHandler, CommandBuffersHandler*& commandBuffersHandler, uint32_t mipLevels = 1){
+        VkCommandBuffer commandBuffer = commandBuffersHandler->beginTransferCommands();
+
+        VkImageMemoryBarrier toTransfer{};
+        toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.image = image;
+        toTransfer.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+        toTransfer.srcAccessMask = 0;
+        toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
             0, nullptr,
             0, nullptr,
-            1, &barrier
-        );
+            1, &toTransfer);
+
+        std::vector<VkBufferImageCopy> regions(mipLevels);
+        for(uint32_t level = 0; level < mipLevels; ++level){
+            uint32_t levelWidth = std::max(width >> level, 1u);
+            uint32_t levelHeight = std::max(height >> level, 1u);
+
+            regions[level].bufferOffset = bufferOffset;
+            regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[level].imageSubresource.mipLevel = level;
+            regions[level].imageSubresource.baseArrayLayer = 0;
+            regions[level].imageSubresource.layerCount = 1;
+            regions[level].imageOffset = {0, 0, 0};
+            regions[level].imageExtent = {levelWidth, levelHeight, 1}; //whole levels, so any transfer granularity is met
+
+            bufferOffset += static_cast<VkDeviceSize>(levelWidth) * levelHeight * 4;
+        }
+
+        vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions.data());
+
+        VkImageMemoryBarrier acquire = ReleaseToGraphics(commandBuffer, image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, mipLevels, deviceHandler);
+        deviceHandler->getImageStates().setState(image, IMAGE_ACCESS_SHADER_READ); //as of the acquire, graphics work recorded later comes after it
+        return commandBuffersHandler->submitTransferCommands(commandBuffer, {}, {acquire}, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
 
-        commandBuffersHandler->endSingleTimeCommands(commandBuffer);
+    //records blitting each level down from the one above it, for every layer at once, leaving all levels in SHADER_READ_ONLY_OPTIMAL
+    //expects level 0 filled and the rest in TRANSFER_DST_OPTIMAL; one barrier call per level, the levels read are moved on together at the end
+    void GenerateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels, DeviceHandler*& deviceHandler, uint32_t layerCount = 1) {
+        //check if image format supports linear blitting
+        if (!deviceHandler->getCapabilities().supportsFormatFeatures(imageFormat, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+            throw std::runtime_error("texture image format does not support linear blitting!");
+
+        BarrierBatcher barriers(deviceHandler);
+
+        int32_t mipWidth = texWidth;
+        int32_t mipHeight = texHeight;
+
+        for (uint32_t i = 1; i < mipLevels; i++) {
+            barriers.transition(image, IMAGE_ACCESS_TRANSFER_SRC, i - 1, 1);
+            barriers.flush(commandBuffer);
+
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = {0, 0, 0};
+            blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = i - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = layerCount;
+            blit.dstOffsets[0] = {0, 0, 0};
+            blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = i;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = layerCount;
+
+            vkCmdBlitImage(commandBuffer,
+                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit,
+                VK_FILTER_LINEAR);
+
+            if (mipWidth > 1) mipWidth /= 2;
+            if (mipHeight > 1) mipHeight /= 2;
+        }
+
+        //levels read by blits are TRANSFER_SRC, the last one TRANSFER_DST: two barriers in one call
+        barriers.transition(image, IMAGE_ACCESS_SHADER_READ, 0, mipLevels);
+        barriers.flush(commandBuffer);
     }
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdint>
+
+//what an image subresource was last used for, BarrierBatcher derives layouts, stages and access masks from it
+enum ImageAccess : uint32_t{
+    IMAGE_ACCESS_UNDEFINED, //contents not needed, nothing to wait for
+    IMAGE_ACCESS_TRANSFER_SRC,
+    IMAGE_ACCESS_TRANSFER_DST,
+    IMAGE_ACCESS_SHADER_READ, //sampled by fragment shaders
+    IMAGE_ACCESS_COLOR_ATTACHMENT,
+    IMAGE_ACCESS_DEPTH_ATTACHMENT
+};
+
+//the access every mip level and array layer of an image was last transitioned to, in command recording order
+//submits go out in the order they were recorded, so the state of the latest recording is the one the next has to start from
+//images made by ImageHelpers are tracked from creation to destruction; only the main thread records transitions
+class ImageStateTracker{
+    struct TrackedImage{
+        uint32_t mipLevels;
+        uint32_t layerCount;
+        VkImageAspectFlags aspect;
+        std::vector<ImageAccess> states; //[layer * mipLevels + mip]
+    };
+
+    std::unordered_map<VkImage, TrackedImage> images;
+
+public:
+    void track(VkImage image, uint32_t mipLevels, uint32_t layerCount, VkImageAspectFlags aspect){
+        images[image] = TrackedImage{mipLevels, layerCount, aspect, std::vector<ImageAccess>(static_cast<size_t>(mipLevels) * layerCount, IMAGE_ACCESS_UNDEFINED)};
+    }
+
+    inline void untrack(VkImage image){ images.erase(image); }
+    inline bool isTracked(VkImage image){ return images.find(image) != images.end(); }
+
+    inline uint32_t getMipLevels(VkImage image){ return get(image).mipLevels; }
+    inline uint32_t getLayerCount(VkImage image){ return get(image).layerCount; }
+    inline VkImageAspectFlags getAspect(VkImage image){ return get(image).aspect; }
+
+    inline ImageAccess getState(VkImage image, uint32_t mip, uint32_t layer){
+        TrackedImage& tracked = get(image);
+        return tracked.states[layer * tracked.mipLevels + mip];
+    }
+
+    //for transitions made without a BarrierBatcher, e.g. by render passes or queue ownership transfers
+    void setState(VkImage image, ImageAccess access, uint32_t baseMip = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS, uint32_t baseLayer = 0, uint32_t layerCount = VK_REMAINING_ARRAY_LAYERS){
+        TrackedImage& tracked = get(image);
+        uint32_t endMip = levelCount == VK_REMAINING_MIP_LEVELS ? tracked.mipLevels : baseMip + levelCount;
+        uint32_t endLayer = layerCount == VK_REMAINING_ARRAY_LAYERS ? tracked.layerCount : baseLayer + layerCount;
+
+        for(uint32_t layer = baseLayer; layer < endLayer; ++layer){
+            for(uint32_t mip = baseMip; mip < endMip; ++mip) tracked.states[layer * tracked.mipLevels + mip] = access;
+        }
+    }
+
+private:
+    TrackedImage& get(VkImage image){
+        auto it = images.find(image);
+        if(it == images.end()) throw std::runtime_error("Image is not tracked.\n");
+        return it->second;
+    }
+};
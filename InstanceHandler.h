@@ -8,6 +8,8 @@
 #include <iostream>
 #include <cstring>
 
+#include "VulkanDispatch.h"
+
 #ifndef DEBUG
 	const bool enableValidationLayers = false;
 #else
@@ -20,6 +22,7 @@ public:
     inline VkInstance& getInstance() { return instance; }
 
     InstanceHandler(const std::vector<const char*>& validationLayers){
+        VulkanDispatch::LoadGlobalCommands();
         if(enableValidationLayers && !checkValidationLayerSupport(validationLayers)) throw std::runtime_error("Validation layer(s) requested, but not available\n");
 
         //technically optional, but provides useful optimization info to the driver
@@ -29,7 +32,7 @@ public:
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = VK_API_VERSION_1_2; //1.2 for timeline semaphores, 1.1 already brought vkGetPhysicalDeviceFeatures2 and maintenance3, which descriptor indexing builds on
 
         //not optional
         VkInstanceCreateInfo createInfo{};
@@ -69,6 +72,7 @@ public:
         else createInfo.enabledLayerCount = 0;
 
         if(vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) throw std::runtime_error("Failed to create Vulkan instance!");
+        VulkanDispatch::LoadInstanceCommands(instance);
 	}
 
     ~InstanceHandler(){
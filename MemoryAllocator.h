@@ -0,0 +1,467 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <stdexcept>
+#include <iostream>
+
+#include "Globals.h"
+#include "DeviceCapabilities.h"
+#include "VulkanDispatch.h"
+
+struct MemoryBlock;
+struct MemoryPool;
+
+//what an allocation is used for, memory is accounted per category and heap
+enum MemoryCategory : uint32_t{
+    MEMORY_CATEGORY_VERTEX,
+    MEMORY_CATEGORY_INDEX,
+    MEMORY_CATEGORY_TEXTURE,
+    MEMORY_CATEGORY_DEPTH,
+    MEMORY_CATEGORY_UNIFORM,
+    MEMORY_CATEGORY_STAGING,
+    MEMORY_CATEGORY_OTHER,
+    MEMORY_CATEGORY_COUNT
+};
+
+const char* const MEMORY_CATEGORY_NAMES[MEMORY_CATEGORY_COUNT] = {"vertex", "index", "texture", "depth", "uniform", "staging", "other"};
+
+//what came of asking a resource to move elsewhere for the defragmenter, see MemoryDefragmenter::MoveFunction
+enum MoveResult : uint32_t{
+    MOVE_DONE, //the copy is recorded and swapped in, the old one retired
+    MOVE_NO_ROOM, //no other block has space for it, so its block cannot be emptied
+    MOVE_BUSY //the resource is being changed, e.g. by a residency change in flight; asked again on a later frame
+};
+
+//where a buffer or image lives: a range of a shared block, or a whole dedicated VkDeviceMemory when block == nullptr
+struct MemoryAllocation{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0; //bytes reserved, can be more than requested
+    void* mapped = nullptr; //host visible memory stays mapped for its whole life, this already points at offset
+    uint32_t memoryType = 0;
+    MemoryBlock* block = nullptr;
+    MemoryCategory category = MEMORY_CATEGORY_OTHER;
+};
+
+//one memory heap as the driver sees it: usage is by this process, budget is what it can use before things start to get paged out
+struct HeapBudget{
+    VkDeviceSize size;
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+    VkMemoryHeapFlags flags;
+};
+
+//one large VkDeviceMemory split up buddy style: every node is a power of two in size and aligned to its size
+struct MemoryBlock{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void* mapped;
+    uint32_t levelCount; //level 0 is the whole block, level i nodes are size >> i
+    std::vector<std::set<VkDeviceSize>> freeNodes; //free node offsets per level
+    std::unordered_map<VkDeviceSize, uint32_t> usedNodes; //allocated node offset -> level
+    VkDeviceSize usedBytes = 0;
+    MemoryPool* pool;
+    bool evacuating = false; //being emptied by the defragmenter: nothing new is placed in it and it is not released behind its back
+};
+
+//blocks of one memory type holding either only linear resources (buffers) or only optimally tiled images
+//keeping the two apart means bufferImageGranularity never has to be padded for
+struct MemoryPool{
+    uint32_t memoryType;
+    bool optimal;
+    std::vector<MemoryBlock*> blocks;
+};
+
+//how scattered the free space inside the sub-allocated blocks is, dedicated allocations have none
+struct FragmentationStats{
+    uint32_t blockCount = 0;
+    VkDeviceSize blockBytes = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize largestFreeNode = 0; //largest request that still fits without a new block
+    float fragmentation = 0.0f; //1 - largest free node / free bytes: 0 when the free space is one node, towards 1 the more it is split up
+};
+
+const VkDeviceSize MEMORY_MIN_NODE_SIZE = 256;
+
+//sub-allocates buffers and images from a few large blocks per memory type instead of one vkAllocateMemory each
+//large resources, and images the driver asks to keep apart, still get dedicated allocations
+class MemoryAllocator{
+    DeviceCapabilities& capabilities;
+    VkDevice logicalDevice;
+    const VkPhysicalDeviceMemoryProperties& memProperties;
+
+    std::vector<MemoryPool> pools; //two per memory type, linear then optimal
+    uint32_t dedicatedCount = 0;
+    std::mutex mutex;
+
+    std::vector<VkDeviceSize> allocatedBytes; //per heap, blocks and dedicated allocations as taken from the driver
+    std::vector<std::array<VkDeviceSize, MEMORY_CATEGORY_COUNT>> categoryBytes; //per heap, what resources actually hold of that
+
+public:
+    MemoryAllocator(DeviceCapabilities& _caps, VkDevice _ld) : capabilities(_caps), logicalDevice(_ld), memProperties(_caps.getMemoryProperties()){
+        pools.resize(memProperties.memoryTypeCount * 2);
+        for(uint32_t i = 0; i < pools.size(); ++i){
+            pools[i].memoryType = i / 2;
+            pools[i].optimal = i % 2 == 1;
+        }
+
+        allocatedBytes.assign(memProperties.memoryHeapCount, 0);
+        categoryBytes.assign(memProperties.memoryHeapCount, {});
+    }
+
+    ~MemoryAllocator(){
+        for(auto& pool : pools){
+            for(MemoryBlock* block : pool.blocks) destroyBlock(block);
+        }
+    }
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties){
+        uint32_t memoryType = capabilities.findMemoryType(typeFilter, properties);
+        if(memoryType == NO_MEMORY_TYPE) throw std::runtime_error("Failed to find suitable memory type.\n");
+        return memoryType;
+    }
+
+    //host visible, coherent flags for memory the cpu reads back from while filling it, cached when the device offers it
+    VkMemoryPropertyFlags getHostReadableFlags(){
+        VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i){
+            if((memProperties.memoryTypes[i].propertyFlags & cached) == cached) return cached;
+        }
+
+        return VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    MemoryAllocation allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MemoryCategory category){
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(logicalDevice, buffer, &memRequirements);
+
+        return allocate(memRequirements, properties, false, false, VK_NULL_HANDLE, category);
+    }
+
+    MemoryAllocation allocateForImage(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling, MemoryCategory category){
+        VkMemoryDedicatedRequirements dedicatedRequirements{};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 memRequirements{};
+        memRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        memRequirements.pNext = &dedicatedRequirements;
+
+        VkImageMemoryRequirementsInfo2 requirementsInfo{};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.image = image;
+
+        vkGetImageMemoryRequirements2(logicalDevice, &requirementsInfo, &memRequirements);
+
+        bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+        return allocate(memRequirements.memoryRequirements, properties, tiling == VK_IMAGE_TILING_OPTIMAL, dedicated, image, category);
+    }
+
+    //memory several images are bound to in turn, lazily allocated memory always gets a VkDeviceMemory of its own
+    MemoryAllocation allocateForAliasing(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, MemoryCategory category){
+        return allocate(memRequirements, properties, true, (properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0, VK_NULL_HANDLE, category);
+    }
+
+    bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties){
+        return capabilities.findMemoryType(typeFilter, properties) != NO_MEMORY_TYPE;
+    }
+
+    void free(MemoryAllocation& allocation){
+        if(allocation.memory == VK_NULL_HANDLE) return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        uint32_t heap = getHeapIndex(allocation.memoryType);
+        categoryBytes[heap][allocation.category] -= allocation.size;
+
+        if(allocation.block == nullptr){
+            vkFreeMemory(logicalDevice, allocation.memory, nullptr); //implicitly unmaps
+            allocatedBytes[heap] -= allocation.size;
+            --dedicatedCount;
+        }
+        else freeNode(allocation.block, allocation.offset);
+
+        allocation = MemoryAllocation{};
+    }
+
+    inline uint32_t getDedicatedCount(){ return dedicatedCount; }
+
+    inline const VkPhysicalDeviceMemoryProperties& getMemoryProperties(){ return memProperties; }
+    inline uint32_t getHeapIndex(uint32_t memoryType){ return memProperties.memoryTypes[memoryType].heapIndex; }
+
+    VkDeviceSize getAllocatedBytes(uint32_t heap){
+        std::lock_guard<std::mutex> lock(mutex);
+        return allocatedBytes[heap];
+    }
+
+    VkDeviceSize getCategoryBytes(uint32_t heap, MemoryCategory category){
+        std::lock_guard<std::mutex> lock(mutex);
+        return categoryBytes[heap][category];
+    }
+
+    uint32_t getBlockCount(){
+        uint32_t count = 0;
+        for(auto& pool : pools) count += static_cast<uint32_t>(pool.blocks.size());
+        return count;
+    }
+
+    FragmentationStats getFragmentationStats(){
+        std::lock_guard<std::mutex> lock(mutex);
+
+        FragmentationStats stats{};
+        for(auto& pool : pools){
+            for(MemoryBlock* block : pool.blocks){
+                ++stats.blockCount;
+                stats.blockBytes += block->size;
+                stats.usedBytes += block->usedBytes;
+
+                for(uint32_t level = 0; level < block->levelCount; ++level){
+                    if(block->freeNodes[level].empty()) continue;
+                    stats.largestFreeNode = std::max(stats.largestFreeNode, block->size >> level);
+                    break;
+                }
+            }
+        }
+
+        VkDeviceSize freeBytes = stats.blockBytes - stats.usedBytes;
+        if(freeBytes > 0) stats.fragmentation = 1.0f - static_cast<float>(stats.largestFreeNode) / static_cast<float>(freeBytes);
+        return stats;
+    }
+
+    //the emptiest block worth emptying that accept(block) agrees to, nullptr if there is none
+    //worth emptying: in a pool with other blocks, at most maxUsage full, and small enough for the rest of the pool to take in
+    template<typename Accept>
+    MemoryBlock* findEvacuationCandidate(float maxUsage, const Accept& accept){
+        std::lock_guard<std::mutex> lock(mutex);
+
+        MemoryBlock* best = nullptr;
+        for(auto& pool : pools){
+            if(pool.blocks.size() < 2) continue;
+
+            VkDeviceSize poolFree = 0;
+            for(MemoryBlock* block : pool.blocks) poolFree += block->size - block->usedBytes;
+
+            for(MemoryBlock* block : pool.blocks){
+                if(block->evacuating || block->usedBytes == 0) continue;
+                if(block->usedBytes > static_cast<VkDeviceSize>(block->size * maxUsage)) continue;
+                if(block->usedBytes > poolFree - (block->size - block->usedBytes)) continue;
+                if(best != nullptr && static_cast<double>(block->usedBytes) / block->size >= static_cast<double>(best->usedBytes) / best->size) continue;
+                if(accept(block)) best = block;
+            }
+        }
+        return best;
+    }
+
+    //stops placing anything new in block until endEvacuation
+    void beginEvacuation(MemoryBlock* block){
+        std::lock_guard<std::mutex> lock(mutex);
+        block->evacuating = true;
+    }
+
+    //makes block usable again, or gives it back to the driver if it was emptied
+    void endEvacuation(MemoryBlock* block){
+        std::lock_guard<std::mutex> lock(mutex);
+        block->evacuating = false;
+        releaseIfEmpty(block);
+    }
+
+    //space for a copy of the resource in allocation, in another block of the same pool; false if none has room, no block is created for it
+    bool allocateMoved(const MemoryAllocation& allocation, const VkMemoryRequirements& memRequirements, MemoryAllocation& moved){
+        if(allocation.block == nullptr) return false; //dedicated allocations are never moved
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        MemoryPool& pool = *allocation.block->pool;
+        if(!(memRequirements.memoryTypeBits & (1 << pool.memoryType))) return false;
+
+        VkDeviceSize blockSize = getBlockSize(pool.memoryType);
+        VkDeviceSize nodeSize = MEMORY_MIN_NODE_SIZE;
+        while(nodeSize < memRequirements.size || nodeSize < memRequirements.alignment) nodeSize <<= 1;
+
+        uint32_t level = 0;
+        while((blockSize >> level) > nodeSize) ++level;
+
+        for(MemoryBlock* block : pool.blocks){
+            if(block == allocation.block || block->evacuating) continue;
+
+            VkDeviceSize offset;
+            if(allocateNode(block, level, offset)){
+                moved = makeAllocation(block, offset, nodeSize, pool.memoryType, allocation.category);
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    //block size for a memory type: MEMORY_BLOCK_SIZE, or an eighth of the heap for small heaps
+    VkDeviceSize getBlockSize(uint32_t memoryType){
+        VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[memoryType].heapIndex].size;
+        VkDeviceSize size = MEMORY_BLOCK_SIZE;
+        while(size > MEMORY_MIN_NODE_SIZE && size > heapSize / 8) size >>= 1;
+        return size;
+    }
+
+    MemoryAllocation allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, bool optimal, bool dedicated, VkImage dedicatedImage, MemoryCategory category){
+        uint32_t memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+        VkDeviceSize blockSize = getBlockSize(memoryType);
+
+        //nodes are aligned to their own size, so rounding up to the alignment satisfies it too
+        VkDeviceSize nodeSize = MEMORY_MIN_NODE_SIZE;
+        while(nodeSize < memRequirements.size || nodeSize < memRequirements.alignment) nodeSize <<= 1;
+
+        if(dedicated || nodeSize > blockSize / 2) return allocateDedicated(memRequirements.size, memoryType, dedicatedImage, category);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        MemoryPool& pool = pools[memoryType * 2 + (optimal ? 1 : 0)];
+        uint32_t level = 0;
+        while((blockSize >> level) > nodeSize) ++level;
+
+        for(MemoryBlock* block : pool.blocks){
+            if(block->evacuating) continue;
+
+            VkDeviceSize offset;
+            if(allocateNode(block, level, offset)) return makeAllocation(block, offset, nodeSize, memoryType, category);
+        }
+
+        MemoryBlock* block = createBlock(pool, blockSize);
+        VkDeviceSize offset;
+        allocateNode(block, level, offset); //a fresh block always has room
+        return makeAllocation(block, offset, nodeSize, memoryType, category);
+    }
+
+    //called with the mutex held
+    MemoryAllocation makeAllocation(MemoryBlock* block, VkDeviceSize offset, VkDeviceSize size, uint32_t memoryType, MemoryCategory category){
+        MemoryAllocation allocation{};
+        allocation.memory = block->memory;
+        allocation.offset = offset;
+        allocation.size = size;
+        allocation.mapped = block->mapped != nullptr ? static_cast<char*>(block->mapped) + offset : nullptr;
+        allocation.memoryType = memoryType;
+        allocation.block = block;
+        allocation.category = category;
+        categoryBytes[getHeapIndex(memoryType)][category] += size;
+        return allocation;
+    }
+
+    MemoryAllocation allocateDedicated(VkDeviceSize size, uint32_t memoryType, VkImage image, MemoryCategory category){
+        VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.image = image;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.pNext = image != VK_NULL_HANDLE ? &dedicatedInfo : nullptr;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        MemoryAllocation allocation{};
+        if(vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS) throw std::runtime_error("Failed to allocate dedicated memory.\n");
+
+        allocation.size = size;
+        allocation.memoryType = memoryType;
+        allocation.category = category;
+        if(memProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) vkMapMemory(logicalDevice, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mapped);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++dedicatedCount;
+        allocatedBytes[getHeapIndex(memoryType)] += size;
+        categoryBytes[getHeapIndex(memoryType)][category] += size;
+        return allocation;
+    }
+
+    MemoryBlock* createBlock(MemoryPool& pool, VkDeviceSize size){
+        MemoryBlock* block = new MemoryBlock{};
+        block->size = size;
+        block->mapped = nullptr;
+        block->pool = &pool;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = pool.memoryType;
+
+        if(vkAllocateMemory(logicalDevice, &allocInfo, nullptr, &block->memory) != VK_SUCCESS){
+            delete block;
+            throw std::runtime_error("Failed to allocate memory block.\n");
+        }
+
+        if(memProperties.memoryTypes[pool.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) vkMapMemory(logicalDevice, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+
+        block->levelCount = 1;
+        while((size >> block->levelCount) >= MEMORY_MIN_NODE_SIZE) ++block->levelCount;
+        block->freeNodes.resize(block->levelCount);
+        block->freeNodes[0].insert(0);
+
+        pool.blocks.push_back(block);
+        allocatedBytes[getHeapIndex(pool.memoryType)] += size;
+        if(DEBUG) std::cout << "Memory allocator: new " << (size >> 20) << " MiB block of memory type " << pool.memoryType << (pool.optimal ? " (images)\n" : " (linear)\n");
+        return block;
+    }
+
+    void destroyBlock(MemoryBlock* block){
+        allocatedBytes[getHeapIndex(block->pool->memoryType)] -= block->size;
+        vkFreeMemory(logicalDevice, block->memory, nullptr);
+        delete block;
+    }
+
+    //takes the first free node of the level, splitting a larger one if there is none
+    bool allocateNode(MemoryBlock* block, uint32_t level, VkDeviceSize& offset){
+        uint32_t source = level;
+        while(block->freeNodes[source].empty()){
+            if(source == 0) return false;
+            --source;
+        }
+
+        offset = *block->freeNodes[source].begin();
+        block->freeNodes[source].erase(block->freeNodes[source].begin());
+
+        //keep the lower half, the upper half of every split becomes a free buddy
+        for(; source < level; ++source) block->freeNodes[source + 1].insert(offset + (block->size >> (source + 1)));
+
+        block->usedNodes[offset] = level;
+        block->usedBytes += block->size >> level;
+        return true;
+    }
+
+    void freeNode(MemoryBlock* block, VkDeviceSize offset){
+        auto it = block->usedNodes.find(offset);
+        if(it == block->usedNodes.end()) throw std::runtime_error("Freeing memory that was not allocated from this block.\n");
+
+        uint32_t level = it->second;
+        block->usedNodes.erase(it);
+        block->usedBytes -= block->size >> level;
+
+        //merge with the buddy for as long as it is free too
+        while(level > 0){
+            VkDeviceSize buddy = offset ^ (block->size >> level);
+            auto buddyIt = block->freeNodes[level].find(buddy);
+            if(buddyIt == block->freeNodes[level].end()) break;
+
+            block->freeNodes[level].erase(buddyIt);
+            offset = std::min(offset, buddy);
+            --level;
+        }
+        block->freeNodes[level].insert(offset);
+
+        releaseIfEmpty(block);
+    }
+
+    //gives an empty block back to the driver, unless it is the pool's last one or still being evacuated
+    void releaseIfEmpty(MemoryBlock* block){
+        MemoryPool& pool = *block->pool;
+        if(block->usedBytes == 0 && !block->evacuating && pool.blocks.size() > 1){
+            pool.blocks.erase(std::find(pool.blocks.begin(), pool.blocks.end(), block));
+            destroyBlock(block);
+        }
+    }
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+
+#include "Globals.h"
+#include "DeviceHandler.h"
+#include "AllocationTracker.h"
+
+//watches every heap's usage against its budget, reports it per allocation category and tells whoever asked when a heap goes over
+class MemoryBudgetHandler{
+public:
+    //heap index and its state at the time it was found over budget
+    using OverBudgetCallback = std::function<void(uint32_t, const HeapBudget&)>;
+
+private:
+    std::vector<HeapBudget> heaps;
+    std::vector<OverBudgetCallback> overBudgetCallbacks;
+    uint64_t frameNumber = 0;
+
+    DeviceHandler* deviceHandler;
+
+public:
+    MemoryBudgetHandler(DeviceHandler*& _dh) : deviceHandler(_dh){
+        deviceHandler->getHeapBudgets(heaps);
+        if(DEBUG) std::cout << "Memory budget: " << (deviceHandler->isMemoryBudgetSupported() ? "VK_EXT_memory_budget" : "estimated from heap sizes") << '\n';
+    }
+
+    inline const std::vector<HeapBudget>& getHeaps(){ return heaps; }
+
+    void addOverBudgetCallback(OverBudgetCallback callback){
+        overBudgetCallbacks.push_back(std::move(callback));
+    }
+
+    //call once per frame, the budget is checked every MEMORY_BUDGET_CHECK_INTERVAL frames and reported every MEMORY_REPORT_INTERVAL in debug builds
+    void update(){
+        ++frameNumber;
+        if(frameNumber % MEMORY_BUDGET_CHECK_INTERVAL == 0) check();
+        if(DEBUG && frameNumber % MEMORY_REPORT_INTERVAL == 0) report(std::cout);
+    }
+
+    //queries the heaps now and calls back for every one over its budget
+    void check(){
+        deviceHandler->getHeapBudgets(heaps);
+
+        for(uint32_t i = 0; i < heaps.size(); ++i){
+            if(heaps[i].usage <= heaps[i].budget) continue;
+            for(auto& callback : overBudgetCallbacks) callback(i, heaps[i]);
+        }
+    }
+
+    void report(std::ostream& out){
+        deviceHandler->getHeapBudgets(heaps);
+        MemoryAllocator& allocator = deviceHandler->getAllocator();
+
+        out << std::fixed << std::setprecision(1);
+        for(uint32_t i = 0; i < heaps.size(); ++i){
+            if(heaps[i].usage == 0 && allocator.getAllocatedBytes(i) == 0) continue;
+
+            out << "Heap " << i << (heaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ? " (device local)" : "") << ": "
+                << toMiB(heaps[i].usage) << " / " << toMiB(heaps[i].budget) << " MiB budget, " << toMiB(heaps[i].size) << " MiB total, "
+                << toMiB(allocator.getAllocatedBytes(i)) << " MiB allocated by us\n";
+
+            for(uint32_t c = 0; c < MEMORY_CATEGORY_COUNT; ++c){
+                VkDeviceSize bytes = allocator.getCategoryBytes(i, static_cast<MemoryCategory>(c));
+                if(bytes > 0) out << "    " << MEMORY_CATEGORY_NAMES[c] << ": " << toMiB(bytes) << " MiB\n";
+            }
+        }
+
+        FragmentationStats fragmentation = allocator.getFragmentationStats();
+        out << "Blocks: " << fragmentation.blockCount << ", " << toMiB(fragmentation.usedBytes) << " / " << toMiB(fragmentation.blockBytes) << " MiB used, largest free node "
+            << toMiB(fragmentation.largestFreeNode) << " MiB, fragmentation " << fragmentation.fragmentation * 100.0f << "%\n";
+        out << "Steady frames checked for allocations: " << AllocationTracker::getSteadyFrameCount() << " of " << AllocationTracker::getFrameCount() << '\n';
+        out.unsetf(std::ios::floatfield);
+    }
+
+private:
+    static double toMiB(VkDeviceSize bytes){ return bytes / (1024.0 * 1024.0); }
+};
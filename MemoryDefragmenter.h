@@ -0,0 +1,209 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "Globals.h"
+#include "DeviceHandler.h"
+#include "CommandBuffersHandler.h"
+#include "BufferHelpers.h"
+
+//empties sparsely used memory blocks a few resources per frame, so the allocator can give them back to the driver
+//only resources registered with it are moved: it copies them on the gpu and their owner swaps in the copy, patching whatever refers to them
+//a frame's copies go out in one submit nobody waits for, ahead of the frame on the graphics queue, so the frame already uses the copies
+class MemoryDefragmenter{
+public:
+    //records copying the resource to memory from MemoryAllocator::allocateMoved into the command buffer, swaps the copy in and retires the old one to the device's DeletionQueue
+    using MoveFunction = std::function<MoveResult(VkCommandBuffer)>;
+
+private:
+    struct Movable{
+        const MemoryAllocation* allocation; //the owner's, so it always reflects where the resource lives now
+        MoveFunction move;
+    };
+
+    std::vector<Movable> movables;
+
+    MemoryBlock* evacuating = nullptr; //block being emptied, one at a time
+    uint64_t frameNumber = 0;
+    uint32_t moveCount = 0;
+    uint32_t releasedBlockCount = 0;
+
+    DeviceHandler* deviceHandler;
+    CommandBuffersHandler* commandBuffersHandler;
+
+public:
+    MemoryDefragmenter(DeviceHandler*& _dh, CommandBuffersHandler*& _cbh) : deviceHandler(_dh), commandBuffersHandler(_cbh){
+
+    }
+
+    ~MemoryDefragmenter(){
+        if(evacuating != nullptr) deviceHandler->getAllocator().endEvacuation(evacuating);
+    }
+
+    inline uint32_t getMoveCount(){ return moveCount; }
+    inline uint32_t getReleasedBlockCount(){ return releasedBlockCount; }
+    inline bool isEvacuating(){ return evacuating != nullptr; }
+
+    //allocation must stay where it is for as long as it is registered, move is called whenever the defragmenter wants the resource elsewhere
+    void registerMovable(const MemoryAllocation* allocation, MoveFunction move){
+        movables.push_back({allocation, std::move(move)});
+    }
+
+    void unregisterMovable(const MemoryAllocation* allocation){
+        movables.erase(std::remove_if(movables.begin(), movables.end(), [allocation](Movable& m){ return m.allocation == allocation; }), movables.end());
+    }
+
+    //a buffer only read by draws, e.g. a vertex or index buffer, that can be replaced by a copy between frames
+    //it must have been created with TRANSFER_SRC usage, buffer and allocation are rewritten in place when it moves
+    void registerBuffer(VkBuffer& buffer, MemoryAllocation& allocation, VkDeviceSize size, VkBufferUsageFlags usage){
+        usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT; //so the copy can be moved again
+
+        registerMovable(&allocation, [this, &buffer, &allocation, size, usage](VkCommandBuffer commandBuffer){
+            VkDevice& device = deviceHandler->getLogicalDevice();
+
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = size;
+            bufferInfo.usage = usage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VkBuffer newBuffer;
+            if(vkCreateBuffer(device, &bufferInfo, nullptr, &newBuffer) != VK_SUCCESS) throw std::runtime_error("Failed to create buffer.\n");
+
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(device, newBuffer, &memRequirements);
+
+            MemoryAllocation newAllocation;
+            if(!deviceHandler->getAllocator().allocateMoved(allocation, memRequirements, newAllocation)){
+                vkDestroyBuffer(device, newBuffer, nullptr);
+                return MOVE_NO_ROOM;
+            }
+            vkBindBufferMemory(device, newBuffer, newAllocation.memory, newAllocation.offset);
+
+            VkBufferCopy copyRegion{};
+            copyRegion.size = size;
+            vkCmdCopyBuffer(commandBuffer, buffer, newBuffer, 1, &copyRegion); //earlier frames only read the old buffer too, nothing to wait for
+
+            //draws of the frames submitted afterwards read the copy
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = newBuffer;
+            barrier.offset = 0;
+            barrier.size = VK_WHOLE_SIZE;
+
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+                0, nullptr,
+                1, &barrier,
+                0, nullptr);
+
+            VkBuffer oldBuffer = buffer;
+            MemoryAllocation oldAllocation = allocation;
+            DeviceHandler* dh = deviceHandler;
+            deviceHandler->getDeletionQueue().retire([dh, oldBuffer, oldAllocation]() mutable { BufferHelpers::DestroyBuffer(oldBuffer, oldAllocation, dh); });
+
+            buffer = newBuffer;
+            allocation = newAllocation;
+            return MOVE_DONE;
+        });
+    }
+
+    //call once per frame after the frame last using the current slot has finished, before anything records or updates descriptors
+    void update(){
+        ++frameNumber;
+
+        if(evacuating == nullptr){
+            if(frameNumber % DEFRAG_CHECK_INTERVAL == 0) beginEvacuation();
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE; //every move of the frame goes into it
+        VkDeviceSize copiedBytes = 0;
+        bool moved = false;
+        bool deferred = false; //something is left in the block for a later frame
+        bool noRoom = false;
+
+        for(auto& m : movables){
+            if(m.allocation->block != evacuating) continue;
+
+            if(moved && (copiedBytes >= DEFRAG_FRAME_BYTES || std::chrono::steady_clock::now() - start > std::chrono::microseconds(DEFRAG_FRAME_BUDGET_US))){
+                deferred = true; //carry on next frame
+                break;
+            }
+
+            if(commandBuffer == VK_NULL_HANDLE) commandBuffer = commandBuffersHandler->beginSingleTimeCommands();
+            VkDeviceSize size = m.allocation->size;
+            MoveResult result = m.move(commandBuffer);
+
+            if(result == MOVE_BUSY){
+                deferred = true;
+                continue;
+            }
+            if(result == MOVE_NO_ROOM){
+                noRoom = true;
+                break;
+            }
+            moved = true;
+            copiedBytes += size;
+            ++moveCount;
+        }
+
+        //handles are already swapped, the frame recorded next is submitted after the copies
+        if(commandBuffer != VK_NULL_HANDLE) commandBuffersHandler->endSingleTimeCommandsAsync(commandBuffer);
+
+        if(noRoom){
+            if(DEBUG) std::cout << "Memory defragmenter: no room left outside the block, giving up on it\n";
+            endEvacuation();
+            return;
+        }
+
+        //everything registered is out, the block empties once the deletion queue has destroyed the old copies
+        if(!moved && !deferred && evacuating->usedBytes == 0) endEvacuation();
+    }
+
+private:
+    VkDeviceSize getMovableBytes(MemoryBlock* block){
+        VkDeviceSize bytes = 0;
+        for(auto& m : movables){
+            if(m.allocation->block == block) bytes += m.allocation->size;
+        }
+        return bytes;
+    }
+
+    //picks the emptiest candidate block that holds nothing but registered resources
+    void beginEvacuation(){
+        MemoryAllocator& allocator = deviceHandler->getAllocator();
+
+        //something we can't move would keep a block alive anyway
+        MemoryBlock* block = allocator.findEvacuationCandidate(DEFRAG_MAX_BLOCK_USAGE, [this](MemoryBlock* b){ return getMovableBytes(b) == b->usedBytes; });
+        if(block == nullptr) return;
+
+        if(DEBUG) std::cout << "Memory defragmenter: emptying a block " << (block->usedBytes * 100 / block->size) << "% in use, fragmentation " << allocator.getFragmentationStats().fragmentation << '\n';
+        allocator.beginEvacuation(block);
+        evacuating = block;
+    }
+
+    void endEvacuation(){
+        bool empty = evacuating->usedBytes == 0;
+        deviceHandler->getAllocator().endEvacuation(evacuating); //releases it if empty
+        evacuating = nullptr;
+
+        if(empty){
+            ++releasedBlockCount;
+            if(DEBUG) std::cout << "Memory defragmenter: block released\n";
+        }
+    }
+};
@@ -12,6 +12,7 @@
 #include <iostream>
 
 #include "Vertex.h"
+#include "TextureSlot.h"
 #include "Globals.h"
 
 //#define OPTIMIZE_VERTICES
@@ -19,6 +20,7 @@
 class ModelHandler{
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+    TextureSlot textureSlot; //where this mesh's texture sits when textures are packed into an array
 
 public:
     ModelHandler(const char* path){
@@ -33,6 +35,8 @@ public:
     inline std::size_t getVertexDataSize() { return vertices.size(); }
     inline uint32_t* getIndicesData() { return indices.data(); }
     inline std::size_t getIndicesDataSize() { return indices.size(); }
+    inline TextureSlot& getTextureSlot() { return textureSlot; }
+    inline void setTextureSlot(const TextureSlot& slot) { textureSlot = slot; }
 
 private:
     void loadModel(const char* path) {
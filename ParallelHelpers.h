@@ -0,0 +1,148 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <functional>
+
+namespace ParallelHelpers {
+    //runs fn(0) .. fn(count - 1) spread over up to one worker per hardware thread and returns once all are done
+    //the first exception thrown by fn is rethrown on the calling thread
+    void ParallelFor(size_t count, const std::function<void(size_t)>& fn){
+        size_t workerCount = std::min<size_t>(count, std::max(std::thread::hardware_concurrency(), 1u));
+        if(workerCount <= 1){
+            for(size_t i = 0; i < count; ++i) fn(i);
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::atomic<bool> failed{false};
+
+        auto work = [&](){
+            for(size_t i = next++; i < count && !failed; i = next++){
+                try{
+                    fn(i);
+                }
+                catch(...){
+                    if(!failed.exchange(true)) error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for(size_t i = 1; i < workerCount; ++i) workers.emplace_back(work);
+        work(); //the calling thread takes part too
+
+        for(auto& w : workers) w.join();
+
+        if(error) std::rethrow_exception(error);
+    }
+
+    //worker threads kept alive for work handed out every frame, where starting threads each time would cost more than the work itself
+    //every run gives each taking part thread its own index, so per thread resources (e.g. command pools) can be indexed by it
+    class ThreadPool{
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        //the current job, type erased without std::function so handing one out never allocates
+        const void* job = nullptr;
+        void (*invoke)(const void*, uint32_t) = nullptr;
+        uint32_t jobThreads = 0; //threads taking part in the current job, the caller included
+        uint32_t remaining = 0; //workers still running the current job
+        uint64_t generation = 0; //bumped for every job so workers never run one twice
+        bool stopping = false;
+        std::exception_ptr error;
+
+    public:
+        ThreadPool(uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u)){
+            for(uint32_t i = 1; i < threadCount; ++i) workers.emplace_back([this, i](){ workerLoop(i); });
+        }
+
+        ~ThreadPool(){
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for(auto& w : workers) w.join();
+        }
+
+        //the calling thread counts as thread 0
+        inline uint32_t getThreadCount(){ return static_cast<uint32_t>(workers.size()) + 1; }
+
+        //runs fn(0) .. fn(threadCount - 1) each on a thread of its own and returns once all are done
+        //fn(0) runs on the calling thread, the first exception thrown by fn is rethrown there
+        template<typename Fn>
+        void run(uint32_t threadCount, const Fn& fn){
+            threadCount = std::min(threadCount, getThreadCount());
+
+            if(threadCount > 1){
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    job = &fn;
+                    invoke = [](const void* f, uint32_t thread){ (*static_cast<const Fn*>(f))(thread); };
+                    jobThreads = threadCount;
+                    remaining = threadCount - 1;
+                    error = nullptr;
+                    ++generation;
+                }
+                wake.notify_all();
+            }
+
+            try{
+                fn(0);
+            }
+            catch(...){
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!error) error = std::current_exception();
+            }
+
+            std::exception_ptr failure;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                done.wait(lock, [this](){ return remaining == 0; });
+                failure = error;
+                error = nullptr;
+            }
+            if(failure) std::rethrow_exception(failure);
+        }
+
+    private:
+        void workerLoop(uint32_t index){
+            uint64_t seen = 0;
+
+            for(;;){
+                const void* current;
+                void (*currentInvoke)(const void*, uint32_t);
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wake.wait(lock, [this, seen](){ return stopping || generation != seen; });
+                    if(stopping) return;
+
+                    seen = generation;
+                    if(index >= jobThreads) continue; //not needed for this one
+                    current = job;
+                    currentInvoke = invoke;
+                }
+
+                try{
+                    currentInvoke(current, index);
+                }
+                catch(...){
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(!error) error = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if(--remaining == 0) done.notify_one();
+            }
+        }
+    };
+}
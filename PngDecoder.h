@@ -0,0 +1,136 @@
+#pragma once
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+
+#include "StbImage.h"
+
+//decodes 8 bit, non-interlaced pngs straight into a caller provided (e.g. mapped staging) buffer as RGBA8
+//the zlib stream is inflated into the tail of the destination and unfiltered forwards into place, so no full size heap buffer is needed
+//palette, 16 bit, interlaced and color keyed images are not handled, callers fall back to stbi_load for those
+namespace PngDecoder {
+    //bytes the destination needs: the RGBA8 image plus one byte per row, since a filtered RGBA row is one byte longer than its output
+    inline size_t GetDecodeSize(uint32_t width, uint32_t height){
+        return static_cast<size_t>(width) * height * 4 + height;
+    }
+
+    inline uint32_t readBigEndian32(const unsigned char* p){
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+
+    inline int paeth(int a, int b, int c){
+        int p = a + b - c;
+        int pa = std::abs(p - a);
+        int pb = std::abs(p - b);
+        int pc = std::abs(p - c);
+        if(pa <= pb && pa <= pc) return a;
+        if(pb <= pc) return b;
+        return c;
+    }
+
+    //false if the file is not a png of the expected size this decoder handles, dst may have been written to either way
+    bool DecodeRGBA8(const char* path, uint32_t width, uint32_t height, unsigned char* dst, size_t dstSize){
+        static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if(!file.is_open()) return false;
+
+        size_t fileSize = static_cast<size_t>(file.tellg());
+        if(fileSize < sizeof(signature)) return false;
+
+        std::vector<unsigned char> fileData(fileSize);
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(fileData.data()), fileSize);
+        if(memcmp(fileData.data(), signature, sizeof(signature)) != 0) return false;
+
+        //only the compressed stream is gathered on the heap, it is a fraction of the decoded size
+        std::vector<char> compressed;
+        uint32_t channels = 0;
+        bool colorKeyed = false;
+
+        for(size_t offset = sizeof(signature); offset + 12 <= fileSize;){
+            uint32_t length = readBigEndian32(&fileData[offset]);
+            const unsigned char* type = &fileData[offset + 4];
+            const unsigned char* data = &fileData[offset + 8];
+            if(length > fileSize - offset - 12) return false;
+
+            if(memcmp(type, "IHDR", 4) == 0){
+                if(length < 13) return false;
+                if(readBigEndian32(data) != width || readBigEndian32(data + 4) != height) return false;
+
+                uint8_t bitDepth = data[8], colorType = data[9], interlace = data[12];
+                if(bitDepth != 8 || interlace != 0) return false;
+
+                switch(colorType){
+                    case 0: channels = 1; break; //gray
+                    case 2: channels = 3; break; //rgb
+                    case 4: channels = 2; break; //gray + alpha
+                    case 6: channels = 4; break; //rgba
+                    default: return false; //palette
+                }
+            }
+            else if(memcmp(type, "tRNS", 4) == 0) colorKeyed = true;
+            else if(memcmp(type, "IDAT", 4) == 0) compressed.insert(compressed.end(), data, data + length);
+            else if(memcmp(type, "IEND", 4) == 0) break;
+
+            offset += 12 + static_cast<size_t>(length);
+        }
+
+        if(channels == 0 || colorKeyed || compressed.empty()) return false;
+
+        size_t rowBytes = static_cast<size_t>(width) * channels + 1; //each filtered row starts with its filter type
+        size_t filteredSize = rowBytes * height;
+        size_t decodeSize = GetDecodeSize(width, height);
+        if(dstSize < decodeSize || filteredSize > INT_MAX || compressed.size() > INT_MAX) return false;
+
+        unsigned char* filtered = dst + decodeSize - filteredSize;
+        int inflated = stbi_zlib_decode_buffer(reinterpret_cast<char*>(filtered), static_cast<int>(filteredSize), compressed.data(), static_cast<int>(compressed.size()));
+        if(inflated != static_cast<int>(filteredSize)) return false;
+
+        //where each png channel lands in an RGBA texel, gray goes to red and is copied to green and blue below
+        static const uint8_t channelOffsets[5][4] = {{}, {0}, {0, 3}, {0, 1, 2}, {0, 1, 2, 3}};
+        const uint8_t* offsets = channelOffsets[channels];
+        size_t outStride = static_cast<size_t>(width) * 4;
+
+        //an output row always ends before the next filtered row starts, and every texel's input is read before its output is written
+        for(uint32_t y = 0; y < height; ++y){
+            const unsigned char* in = filtered + y * rowBytes;
+            unsigned char filter = *in++;
+            if(filter > 4) return false;
+
+            unsigned char* out = dst + y * outStride;
+            const unsigned char* prior = y > 0 ? out - outStride : nullptr;
+
+            for(uint32_t x = 0; x < width; ++x){
+                unsigned char raw[4];
+                memcpy(raw, in + static_cast<size_t>(x) * channels, channels);
+
+                unsigned char* texel = out + static_cast<size_t>(x) * 4;
+                for(uint32_t k = 0; k < channels; ++k){
+                    size_t o = offsets[k];
+                    int a = x > 0 ? (texel - 4)[o] : 0;
+                    int b = prior != nullptr ? prior[x * 4 + o] : 0;
+                    int c = x > 0 && prior != nullptr ? prior[(x - 1) * 4 + o] : 0;
+
+                    int predicted = 0;
+                    switch(filter){
+                        case 1: predicted = a; break;
+                        case 2: predicted = b; break;
+                        case 3: predicted = (a + b) / 2; break;
+                        case 4: predicted = paeth(a, b, c); break;
+                    }
+                    texel[o] = static_cast<unsigned char>(raw[k] + predicted);
+                }
+
+                if(channels <= 2) texel[1] = texel[2] = texel[0];
+                if(channels == 1 || channels == 3) texel[3] = 255;
+            }
+        }
+
+        return true;
+    }
+}
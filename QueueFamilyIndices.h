@@ -12,11 +12,17 @@
 struct QueueFamilyIndices{
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily; //the queue that supports drawing and presenting may vary. You can create logic to prefer devices that have this as one queue for better performance
+	std::optional<uint32_t> transferFamily; //a family without graphics, usually the dma engines, so copies run beside rendering; the graphics family when there is none
 
 	bool isComplete(){
 		return graphicsFamily.has_value() && presentFamily.has_value();
 	}
 
+	//resources moving between a separate transfer family and the graphics family need ownership transfer barriers
+	bool hasDedicatedTransfer(){
+		return transferFamily.has_value() && transferFamily != graphicsFamily;
+	}
+
 	QueueFamilyIndices(){
 
 	}
@@ -24,6 +30,7 @@ struct QueueFamilyIndices{
 	QueueFamilyIndices(QueueFamilyIndices& other){
 		graphicsFamily = other.graphicsFamily;
 		presentFamily = other.presentFamily;
+		transferFamily = other.transferFamily;
 	}
 
 	QueueFamilyIndices(const VkPhysicalDevice& device, SurfaceHandler* surfaceHandler){		
@@ -44,5 +51,18 @@ struct QueueFamilyIndices{
 			if(isComplete()) break;
 			++i;
 		}
+
+		//transfer only families first, then ones that can at least not draw, otherwise copies share the graphics queue
+		for(uint32_t family = 0; family < queueFamilyCount; ++family){
+			VkQueueFlags flags = queueFamilies[family].queueFlags;
+			if(!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) continue;
+
+			if(!(flags & VK_QUEUE_COMPUTE_BIT)){
+				transferFamily = family;
+				break;
+			}
+			if(!transferFamily.has_value()) transferFamily = family;
+		}
+		if(!transferFamily.has_value()) transferFamily = graphicsFamily;
 	}
 };
\ No newline at end of file
@@ -0,0 +1,675 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+#include "Globals.h"
+#include "DeviceHandler.h"
+#include "ImageHelpers.h"
+#include "TransientAttachmentPool.h"
+
+//how a pass uses a resource, each maps to the stage, access and layout the graph synchronizes on
+enum GraphUsage : uint32_t{
+    GRAPH_USAGE_NONE, //no earlier use, contents undefined
+    GRAPH_USAGE_COLOR_ATTACHMENT,
+    GRAPH_USAGE_DEPTH_ATTACHMENT,
+    GRAPH_USAGE_SAMPLED, //read by fragment shaders
+    GRAPH_USAGE_TRANSFER_SRC,
+    GRAPH_USAGE_TRANSFER_DST,
+    GRAPH_USAGE_PRESENT, //final usage of swapchain images, the present waits on a semaphore
+    GRAPH_USAGE_HOST_READ //final usage of buffers the cpu reads once the frame has finished
+};
+
+//which copy of an imported resource a frame uses
+enum GraphIndexing : uint32_t{
+    GRAPH_INDEX_SINGLE,
+    GRAPH_INDEX_FRAME, //one per frame in flight
+    GRAPH_INDEX_IMAGE //one per swapchain image
+};
+
+//the frame's passes and the resources they read and write, recorded in declaration order
+//from the declarations it derives what used to be written by hand: render passes with their load/store ops, layouts and subpass dependencies,
+//one batched barrier before every other pass, passes whose results nothing uses are culled and transient attachments with disjoint lifetimes share memory
+class RenderGraph{
+public:
+    //what a pass records with, renderPass and framebuffer are VK_NULL_HANDLE outside of graphics passes
+    struct Context{
+        uint32_t frame;
+        uint32_t image;
+        VkRenderPass renderPass;
+        VkFramebuffer framebuffer;
+        VkExtent2D extent;
+    };
+
+    //graphics passes record inside their render pass, already begun
+    using RecordFunction = std::function<void(VkCommandBuffer, const Context&)>;
+
+private:
+    struct UsageState{
+        VkPipelineStageFlags stage;
+        VkAccessFlags access;
+        VkImageLayout layout;
+        bool write;
+    };
+
+    struct Resource{
+        const char* name;
+        bool isImage;
+        bool transient = false; //created by the graph, attachment usages only
+        GraphIndexing indexing = GRAPH_INDEX_SINGLE;
+        GraphUsage finalUsage = GRAPH_USAGE_NONE; //outputs are never culled and end in this usage
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkImageAspectFlags aspect = 0;
+        VkExtent2D extent{}; //transient images, 0x0 follows the swapchain
+        const VkExtent2D* importedExtent = nullptr;
+        const std::vector<VkImage>* images = nullptr;
+        const std::vector<VkImageView>* views = nullptr;
+        const std::vector<VkBuffer>* buffers = nullptr;
+
+        //transient images
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t aliasGroup = ALIAS_GROUP_NONE;
+
+        std::vector<std::pair<uint32_t, GraphUsage>> uses; //(pass, usage) of the passes left after culling, in order
+    };
+
+    struct Attachment{
+        uint32_t resource;
+        bool clear;
+        VkClearValue clearValue;
+    };
+
+    struct Barrier{
+        uint32_t resource;
+        UsageState src;
+        UsageState dst;
+    };
+
+    struct Pass{
+        const char* name;
+        bool graphics;
+        bool secondaryContents = false;
+        RecordFunction record;
+        std::vector<Attachment> attachments; //graphics passes, in attachment order, also in uses
+        std::vector<std::pair<uint32_t, GraphUsage>> uses; //(resource, usage)
+
+        bool culled = false;
+        bool perFrame = false; //framebuffers follow the frame slot and/or the swapchain image
+        bool perImage = false;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        std::vector<VkFramebuffer> framebuffers;
+        std::vector<VkClearValue> clearValues;
+        std::vector<Barrier> barriers; //recorded right before the pass
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<Barrier> finalBarriers; //outputs into their final usage after the last pass
+    bool compiled = false;
+
+    uint32_t frameCount = 0;
+    uint32_t imageCount = 0;
+    const VkExtent2D& swapchainExtent;
+
+    std::vector<VkImageMemoryBarrier> imageBarriers; //scratch, reused at every sync point
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+
+    DeviceHandler* deviceHandler;
+
+public:
+    RenderGraph(DeviceHandler*& _dh, const VkExtent2D& _swapchainExtent) : swapchainExtent(_swapchainExtent), deviceHandler(_dh){
+
+    }
+
+    ~RenderGraph(){
+        destroyTargets();
+        for(auto& pass : passes){
+            if(pass.renderPass != VK_NULL_HANDLE) vkDestroyRenderPass(deviceHandler->getLogicalDevice(), pass.renderPass, nullptr);
+        }
+    }
+
+    //an image owned elsewhere, the vectors are read again whenever targets are rebuilt so their owner may resize them in between
+    //a finalUsage other than GRAPH_USAGE_NONE makes it an output
+    uint32_t importImage(const char* name, VkFormat format, VkImageAspectFlags aspect, GraphIndexing indexing, const std::vector<VkImage>& images, const std::vector<VkImageView>& views, const VkExtent2D& extent, GraphUsage finalUsage = GRAPH_USAGE_NONE){
+        Resource r{};
+        r.name = name;
+        r.isImage = true;
+        r.indexing = indexing;
+        r.finalUsage = finalUsage;
+        r.format = format;
+        r.aspect = aspect;
+        r.importedExtent = &extent;
+        r.images = &images;
+        r.views = &views;
+        return addResource(r);
+    }
+
+    uint32_t importBuffer(const char* name, GraphIndexing indexing, const std::vector<VkBuffer>& buffers, GraphUsage finalUsage = GRAPH_USAGE_NONE){
+        Resource r{};
+        r.name = name;
+        r.isImage = false;
+        r.indexing = indexing;
+        r.finalUsage = finalUsage;
+        r.buffers = &buffers;
+        return addResource(r);
+    }
+
+    //an attachment that lives only within the frame, its memory is shared with transients used at other times
+    //one image serves every frame in flight, the graph orders each frame's use after the previous one's
+    uint32_t createImage(const char* name, VkFormat format, VkImageAspectFlags aspect, VkExtent2D extent = {0, 0}){
+        Resource r{};
+        r.name = name;
+        r.isImage = true;
+        r.transient = true;
+        r.format = format;
+        r.aspect = aspect;
+        r.extent = extent;
+        return addResource(r);
+    }
+
+    //secondaryContents: the pass only executes secondary command buffers
+    uint32_t addGraphicsPass(const char* name, RecordFunction record, bool secondaryContents = false){
+        Pass pass{};
+        pass.name = name;
+        pass.graphics = true;
+        pass.secondaryContents = secondaryContents;
+        pass.record = std::move(record);
+        return addPass(pass);
+    }
+
+    //copies and anything else recorded outside a render pass
+    uint32_t addPass(const char* name, RecordFunction record){
+        Pass pass{};
+        pass.name = name;
+        pass.graphics = false;
+        pass.record = std::move(record);
+        return addPass(pass);
+    }
+
+    //without clear the attachment keeps what earlier passes of the frame wrote
+    void addColorAttachment(uint32_t pass, uint32_t resource, bool clear, VkClearValue clearValue = {}){
+        addAttachment(pass, resource, GRAPH_USAGE_COLOR_ATTACHMENT, clear, clearValue);
+    }
+
+    void addDepthAttachment(uint32_t pass, uint32_t resource, bool clear, VkClearValue clearValue = {}){
+        addAttachment(pass, resource, GRAPH_USAGE_DEPTH_ATTACHMENT, clear, clearValue);
+    }
+
+    //a use outside of attachments, e.g. a copy source, each pass uses a resource once
+    void use(uint32_t pass, uint32_t resource, GraphUsage usage){
+        checkUnused(pass, resource);
+        passes[pass].uses.push_back({resource, usage});
+    }
+
+    //derives everything from the declarations and creates the targets, passes must not be added afterwards
+    void compile(uint32_t _frameCount, uint32_t _imageCount){
+        if(compiled) throw std::runtime_error("Render graph is already compiled.\n");
+
+        cull();
+        collectUses();
+        assignAliasGroups();
+        for(uint32_t p = 0; p < passes.size(); ++p){
+            if(passes[p].culled) continue;
+            if(passes[p].graphics) createRenderPass(p);
+            else collectBarriers(p);
+        }
+        collectFinalBarriers();
+        compiled = true;
+
+        if(DEBUG){
+            for(auto& pass : passes) std::cout << "Render graph: pass " << pass.name << (pass.culled ? " culled" : "") << ", " << pass.barriers.size() << " barriers\n";
+        }
+
+        rebuild(_frameCount, _imageCount);
+    }
+
+    //recreates transient attachments and framebuffers, after the swapchain, an imported resource or the frames in flight changed
+    //frames still executing keep the old ones until they finish, see DeletionQueue; render passes are kept, formats must not change
+    void rebuild(uint32_t _frameCount, uint32_t _imageCount){
+        retireTargets();
+        frameCount = _frameCount;
+        imageCount = _imageCount;
+        createTargets();
+    }
+
+    //for pipelines, compatible with the pass for as long as the graph lives
+    inline VkRenderPass& getRenderPass(uint32_t pass){ return passes[pass].renderPass; }
+
+    //records every pass left after culling with its barriers, for frame slot frame and swapchain image image
+    void execute(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t image){
+        for(auto& pass : passes){
+            if(pass.culled) continue;
+
+            recordBarriers(commandBuffer, pass.barriers, frame, image);
+
+            Context context{};
+            context.frame = frame;
+            context.image = image;
+
+            if(!pass.graphics){
+                pass.record(commandBuffer, context);
+                continue;
+            }
+
+            context.renderPass = pass.renderPass;
+            context.framebuffer = pass.framebuffers[(pass.perFrame ? frame : 0) * (pass.perImage ? imageCount : 1) + (pass.perImage ? image : 0)];
+            context.extent = getExtent(pass.attachments[0].resource);
+
+            VkRenderPassBeginInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = context.renderPass;
+            renderPassInfo.framebuffer = context.framebuffer;
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = context.extent;
+            renderPassInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+            renderPassInfo.pClearValues = pass.clearValues.data();
+
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass.secondaryContents ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+            pass.record(commandBuffer, context);
+            vkCmdEndRenderPass(commandBuffer);
+        }
+
+        recordBarriers(commandBuffer, finalBarriers, frame, image);
+    }
+
+private:
+    uint32_t addResource(Resource& r){
+        if(compiled) throw std::runtime_error("Resources cannot be added to a compiled render graph.\n");
+        resources.push_back(r);
+        return static_cast<uint32_t>(resources.size() - 1);
+    }
+
+    uint32_t addPass(Pass& pass){
+        if(compiled) throw std::runtime_error("Passes cannot be added to a compiled render graph.\n");
+        passes.push_back(std::move(pass));
+        return static_cast<uint32_t>(passes.size() - 1);
+    }
+
+    void addAttachment(uint32_t pass, uint32_t resource, GraphUsage usage, bool clear, VkClearValue clearValue){
+        if(!passes[pass].graphics) throw std::runtime_error("Only graphics passes have attachments.\n");
+        use(pass, resource, usage);
+        passes[pass].attachments.push_back({resource, clear, clearValue});
+    }
+
+    void checkUnused(uint32_t pass, uint32_t resource){
+        for(auto& u : passes[pass].uses){
+            if(u.first == resource) throw std::runtime_error("A pass can use a render graph resource only once.\n");
+        }
+    }
+
+    static UsageState getUsageState(GraphUsage usage){
+        switch(usage){
+            case GRAPH_USAGE_COLOR_ATTACHMENT: return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true};
+            case GRAPH_USAGE_DEPTH_ATTACHMENT: return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true};
+            case GRAPH_USAGE_SAMPLED: return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false};
+            case GRAPH_USAGE_TRANSFER_SRC: return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false};
+            case GRAPH_USAGE_TRANSFER_DST: return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true};
+            case GRAPH_USAGE_PRESENT: return {VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false};
+            case GRAPH_USAGE_HOST_READ: return {VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false};
+            default: return {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, false};
+        }
+    }
+
+    static bool isWrite(GraphUsage usage){ return getUsageState(usage).write; }
+
+    //a pass is kept if it writes an output or something a kept later pass reads; attachments that are not cleared are read too
+    void cull(){
+        std::vector<bool> needed(resources.size(), false);
+        for(size_t r = 0; r < resources.size(); ++r) needed[r] = resources[r].finalUsage != GRAPH_USAGE_NONE;
+
+        for(size_t p = passes.size(); p-- > 0;){
+            Pass& pass = passes[p];
+
+            bool writesNeeded = false;
+            for(auto& u : pass.uses) writesNeeded |= isWrite(u.second) && needed[u.first];
+            pass.culled = !writesNeeded;
+            if(pass.culled) continue;
+
+            for(auto& u : pass.uses){
+                bool reads = !isWrite(u.second);
+                for(auto& a : pass.attachments) reads |= a.resource == u.first && !a.clear;
+                if(reads) needed[u.first] = true;
+            }
+        }
+    }
+
+    void collectUses(){
+        for(uint32_t p = 0; p < passes.size(); ++p){
+            if(passes[p].culled) continue;
+            for(auto& u : passes[p].uses) resources[u.first].uses.push_back({p, u.second});
+        }
+    }
+
+    //transients whose first and last passes do not overlap take turns on the same memory, larger ones are created first so the others fit
+    void assignAliasGroups(){
+        std::vector<uint32_t> transients;
+        for(uint32_t r = 0; r < resources.size(); ++r){
+            if(resources[r].transient && !resources[r].uses.empty()) transients.push_back(r);
+        }
+        std::sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b){ return resources[a].uses.front().first < resources[b].uses.front().first; });
+
+        std::vector<uint32_t> groupLastPass;
+        for(uint32_t r : transients){
+            Resource& resource = resources[r];
+            uint32_t group = 0;
+            while(group < groupLastPass.size() && groupLastPass[group] >= resource.uses.front().first) ++group;
+
+            if(group == groupLastPass.size()) groupLastPass.push_back(0);
+            groupLastPass[group] = resource.uses.back().first;
+            resource.aliasGroup = ALIAS_GROUP_RENDER_GRAPH + group;
+        }
+    }
+
+    //the state the k-th use of a resource has to wait for
+    //first uses of transients wait for the last use of every transient sharing their memory, in this frame or the one before, and start from UNDEFINED
+    //first uses of imported resources only wait for their own stage, which chains them after the semaphore waits of the submit
+    UsageState getPreviousState(uint32_t r, size_t k){
+        Resource& resource = resources[r];
+        if(k > 0) return getUsageState(resource.uses[k - 1].second);
+
+        UsageState state = getUsageState(resource.uses[k].second);
+        state.access = 0;
+        state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        state.write = false;
+        if(!resource.transient) return state;
+
+        for(auto& other : resources){
+            if(!other.transient || other.uses.empty() || other.aliasGroup != resource.aliasGroup) continue;
+
+            UsageState last = getUsageState(other.uses.back().second);
+            state.stage |= last.stage;
+            if(last.write) state.access |= last.access;
+        }
+        state.write = state.access != 0;
+        return state;
+    }
+
+    size_t findUse(uint32_t r, uint32_t p){
+        for(size_t k = 0; k < resources[r].uses.size(); ++k){
+            if(resources[r].uses[k].first == p) return k;
+        }
+        throw std::runtime_error("Render graph resource is not used by the pass.\n");
+    }
+
+    void createRenderPass(uint32_t p){
+        Pass& pass = passes[p];
+
+        std::vector<VkAttachmentDescription> descriptions;
+        std::vector<VkAttachmentReference> colorReferences;
+        VkAttachmentReference depthReference{};
+        bool hasDepth = false;
+
+        VkSubpassDependency incoming{}; //whatever touched the attachments before, including the transition out of UNDEFINED
+        incoming.srcSubpass = VK_SUBPASS_EXTERNAL;
+        incoming.dstSubpass = 0;
+        VkSubpassDependency outgoing{}; //later uses outside render passes, those inside have their own incoming dependency
+        outgoing.srcSubpass = 0;
+        outgoing.dstSubpass = VK_SUBPASS_EXTERNAL;
+
+        for(auto& a : pass.attachments){
+            Resource& resource = resources[a.resource];
+            size_t k = findUse(a.resource, p);
+            GraphUsage usage = resource.uses[k].second;
+            UsageState state = getUsageState(usage);
+            UsageState previous = getPreviousState(a.resource, k);
+
+            bool hasNext = k + 1 < resource.uses.size();
+            bool nextIsGraphics = hasNext && passes[resource.uses[k + 1].first].graphics;
+            GraphUsage nextUsage = hasNext ? resource.uses[k + 1].second : resource.finalUsage;
+            UsageState next = getUsageState(nextUsage);
+
+            VkAttachmentDescription description{};
+            description.format = resource.format;
+            description.samples = VK_SAMPLE_COUNT_1_BIT;
+            description.loadOp = a.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : k > 0 ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            description.storeOp = nextUsage != GRAPH_USAGE_NONE ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            description.initialLayout = description.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? previous.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+            description.finalLayout = nextUsage != GRAPH_USAGE_NONE ? next.layout : state.layout;
+
+            VkAttachmentReference reference{};
+            reference.attachment = static_cast<uint32_t>(descriptions.size());
+            reference.layout = state.layout;
+            if(usage == GRAPH_USAGE_DEPTH_ATTACHMENT){
+                if(hasDepth) throw std::runtime_error("A render graph pass can have one depth attachment.\n");
+                depthReference = reference;
+                hasDepth = true;
+            }
+            else colorReferences.push_back(reference);
+            descriptions.push_back(description);
+
+            incoming.srcStageMask |= previous.stage;
+            if(previous.write) incoming.srcAccessMask |= previous.access;
+            incoming.dstStageMask |= state.stage;
+            incoming.dstAccessMask |= state.access;
+
+            if(nextUsage != GRAPH_USAGE_NONE && nextUsage != GRAPH_USAGE_PRESENT && !nextIsGraphics){
+                outgoing.srcStageMask |= state.stage;
+                outgoing.srcAccessMask |= state.access & (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+                outgoing.dstStageMask |= next.stage;
+                outgoing.dstAccessMask |= next.access;
+            }
+
+            pass.clearValues.push_back(a.clearValue);
+            pass.perFrame |= !resource.transient && resource.indexing == GRAPH_INDEX_FRAME;
+            pass.perImage |= !resource.transient && resource.indexing == GRAPH_INDEX_IMAGE;
+        }
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+        subpass.pColorAttachments = colorReferences.data();
+        subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+        std::vector<VkSubpassDependency> dependencies = {incoming};
+        if(outgoing.dstStageMask != 0) dependencies.push_back(outgoing);
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(descriptions.size());
+        renderPassInfo.pAttachments = descriptions.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+
+        if(vkCreateRenderPass(deviceHandler->getLogicalDevice(), &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS) throw std::runtime_error("Failed to create render graph render pass.\n");
+    }
+
+    //a use after a render pass was already transitioned and synchronized by its outgoing dependency
+    //otherwise a barrier is needed for a layout change or whenever either side writes
+    void collectBarriers(uint32_t p){
+        Pass& pass = passes[p];
+
+        for(auto& u : pass.uses){
+            Resource& resource = resources[u.first];
+            if(resource.transient) throw std::runtime_error("Transient render graph images can only be used as attachments.\n");
+
+            size_t k = findUse(u.first, p);
+            if(k > 0 && passes[resource.uses[k - 1].first].graphics) continue;
+            if(k == 0 && !resource.isImage) continue; //earlier frames' uses are ordered by the frame timeline
+
+            UsageState previous = getPreviousState(u.first, k);
+            UsageState state = getUsageState(u.second);
+            bool layoutChange = resource.isImage && previous.layout != state.layout;
+            if(layoutChange || previous.write || state.write) pass.barriers.push_back({u.first, previous, state});
+        }
+    }
+
+    void collectFinalBarriers(){
+        for(uint32_t r = 0; r < resources.size(); ++r){
+            Resource& resource = resources[r];
+            if(resource.finalUsage == GRAPH_USAGE_NONE || resource.uses.empty()) continue;
+            if(passes[resource.uses.back().first].graphics) continue; //the render pass's final layout and outgoing dependency
+
+            finalBarriers.push_back({r, getUsageState(resource.uses.back().second), getUsageState(resource.finalUsage)});
+        }
+    }
+
+    //one vkCmdPipelineBarrier for all of them
+    void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers, uint32_t frame, uint32_t image){
+        if(barriers.empty()) return;
+
+        imageBarriers.clear();
+        bufferBarriers.clear();
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+
+        for(auto& b : barriers){
+            Resource& resource = resources[b.resource];
+            srcStages |= b.src.stage;
+            dstStages |= b.dst.stage;
+
+            if(resource.isImage){
+                VkImageMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.srcAccessMask = b.src.write ? b.src.access : 0;
+                barrier.dstAccessMask = b.dst.access;
+                barrier.oldLayout = b.src.layout;
+                barrier.newLayout = b.dst.layout;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = (*resource.images)[getIndex(resource, frame, image)];
+                barrier.subresourceRange = {resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+                imageBarriers.push_back(barrier);
+            }
+            else{
+                VkBufferMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.srcAccessMask = b.src.write ? b.src.access : 0;
+                barrier.dstAccessMask = b.dst.access;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.buffer = (*resource.buffers)[getIndex(resource, frame, image)];
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+                bufferBarriers.push_back(barrier);
+            }
+        }
+
+        vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0,
+            0, nullptr,
+            static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+            static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+    }
+
+    inline size_t getIndex(Resource& resource, uint32_t frame, uint32_t image){
+        return resource.indexing == GRAPH_INDEX_FRAME ? frame : resource.indexing == GRAPH_INDEX_IMAGE ? image : 0;
+    }
+
+    VkExtent2D getExtent(uint32_t r){
+        Resource& resource = resources[r];
+        if(!resource.transient) return *resource.importedExtent;
+        return resource.extent.width == 0 ? swapchainExtent : resource.extent;
+    }
+
+    VkImageView getView(uint32_t r, uint32_t frame, uint32_t image){
+        Resource& resource = resources[r];
+        return resource.transient ? resource.view : (*resource.views)[getIndex(resource, frame, image)];
+    }
+
+    void createTargets(){
+        VkDevice& device = deviceHandler->getLogicalDevice();
+
+        std::vector<uint32_t> transients;
+        for(uint32_t r = 0; r < resources.size(); ++r){
+            if(resources[r].transient && !resources[r].uses.empty()) transients.push_back(r);
+        }
+        std::sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b){
+            VkExtent2D ea = getExtent(a), eb = getExtent(b);
+            return static_cast<uint64_t>(ea.width) * ea.height > static_cast<uint64_t>(eb.width) * eb.height;
+        });
+
+        for(uint32_t r : transients){
+            Resource& resource = resources[r];
+
+            VkImageUsageFlags usage = 0;
+            for(auto& u : resource.uses) usage |= u.second == GRAPH_USAGE_DEPTH_ATTACHMENT ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+            VkExtent2D extent = getExtent(r);
+            resource.image = deviceHandler->getTransientAttachments().createImage(extent.width, extent.height, resource.format, usage, static_cast<AliasGroup>(resource.aliasGroup));
+            resource.view = ImageHelpers::CreateImageView(resource.image, resource.format, resource.aspect, 1, device);
+        }
+
+        for(auto& pass : passes){
+            if(pass.culled || !pass.graphics) continue;
+
+            uint32_t frames = pass.perFrame ? frameCount : 1;
+            uint32_t images = pass.perImage ? imageCount : 1;
+            VkExtent2D extent = getExtent(pass.attachments[0].resource);
+            pass.framebuffers.resize(frames * images);
+
+            std::vector<VkImageView> views(pass.attachments.size());
+            for(uint32_t frame = 0; frame < frames; ++frame){
+                for(uint32_t image = 0; image < images; ++image){
+                    for(size_t a = 0; a < views.size(); ++a) views[a] = getView(pass.attachments[a].resource, frame, image);
+
+                    VkFramebufferCreateInfo framebufferInfo{};
+                    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+                    framebufferInfo.renderPass = pass.renderPass;
+                    framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+                    framebufferInfo.pAttachments = views.data();
+                    framebufferInfo.width = extent.width;
+                    framebufferInfo.height = extent.height;
+                    framebufferInfo.layers = 1;
+
+                    if(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &pass.framebuffers[frame * images + image]) != VK_SUCCESS) throw std::runtime_error("Failed to create render graph framebuffer.\n");
+                }
+            }
+        }
+    }
+
+    //new transients may alias the memory of the retired ones, every use starts from UNDEFINED after the incoming dependency of its pass
+    void retireTargets(){
+        DeviceHandler* dh = deviceHandler;
+
+        for(auto& pass : passes){
+            std::vector<VkFramebuffer> framebuffers;
+            framebuffers.swap(pass.framebuffers);
+            if(framebuffers.empty()) continue;
+
+            deviceHandler->getDeletionQueue().retire([dh, framebuffers](){
+                for(VkFramebuffer framebuffer : framebuffers) vkDestroyFramebuffer(dh->getLogicalDevice(), framebuffer, nullptr);
+            });
+        }
+
+        for(auto& resource : resources){
+            if(resource.image == VK_NULL_HANDLE) continue;
+
+            VkImage image = resource.image;
+            VkImageView view = resource.view;
+            deviceHandler->getDeletionQueue().retire([dh, image, view](){
+                vkDestroyImageView(dh->getLogicalDevice(), view, nullptr);
+                dh->getTransientAttachments().destroyImage(image);
+            });
+            resource.image = VK_NULL_HANDLE;
+            resource.view = VK_NULL_HANDLE;
+        }
+    }
+
+    void destroyTargets(){
+        VkDevice& device = deviceHandler->getLogicalDevice();
+
+        for(auto& pass : passes){
+            for(VkFramebuffer framebuffer : pass.framebuffers) vkDestroyFramebuffer(device, framebuffer, nullptr);
+            pass.framebuffers.clear();
+        }
+
+        for(auto& resource : resources){
+            if(resource.image == VK_NULL_HANDLE) continue;
+            vkDestroyImageView(device, resource.view, nullptr);
+            deviceHandler->getTransientAttachments().destroyImage(resource.image);
+            resource.image = VK_NULL_HANDLE;
+            resource.view = VK_NULL_HANDLE;
+        }
+    }
+};
@@ -37,8 +37,17 @@
 #include "DescriptorSetsHandler.h"
 #include "GraphicsPipelineHandler.h"
 #include "CommandBuffersHandler.h"
-#include "DepthResourcesHandler.h"
 #include "ModelHandler.h"
+#include "TextureResidencyManager.h"
+#include "VirtualTextureHandler.h"
+#include "TextureArrayHandler.h"
+#include "MemoryBudgetHandler.h"
+#include "MemoryDefragmenter.h"
+#include "SecondaryCommandBuffersHandler.h"
+#include "CommandBufferCache.h"
+#include "RenderGraph.h"
+#include "ParallelHelpers.h"
+#include "AllocationTracker.h"
 
 glm::mat4 correction(
         glm::vec4(1.0f,  0.0f, 0.0f, 0.0f),
@@ -49,6 +58,7 @@ glm::mat4 correction(
 struct Camera {
 	UniformBuffers* uniformBuffers;
 	UniformBufferObject ubo;
+	uint32_t uboOffset = 0; //where this frame's ubo landed in the uniform arena
 	SwapchainHandler* swapchainHandler;
 
 	Camera(DeviceHandler* _dh, SwapchainHandler* _sh) : swapchainHandler(_sh){
@@ -70,7 +80,7 @@ struct Camera {
 		ubo.projection[1][1] *= -1; //glm was originally for opengl which has the y clip coordinates inverted from Vulkan
 		ubo.view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 
-		uniformBuffers->updateUniformBuffer(ubo, currentFrame);
+		uboOffset = uniformBuffers->updateUniformBuffer(ubo, currentFrame);
 	}
 
 	glm::vec3 cameraDirection;
@@ -83,6 +93,13 @@ struct Camera {
 
 Camera* camera;
 
+//one indexed draw of the scene's geometry, recorded by whichever thread its range of the draw list lands on
+struct DrawCommand{
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	TextureSlot textureSlot;
+};
+
 void processInput(GLFWwindow* window) {
     //if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) glfwSetWindowShouldClose(window, true);
 
@@ -135,16 +152,21 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
 uint32_t currentFrame = 0;
 
 static void framebufferResizeCallback(GLFWwindow*, int, int);
+static void keyCallback(GLFWwindow*, int, int, int, int);
 
 class Renderer{
 public:
 	bool framebufferResized = false;
+	uint32_t requestedFramesInFlight = 0; //applied at the start of the next frame, 0 when no change is pending
+
+	inline uint32_t getFramesInFlight(){ return deviceHandler->getFrameTimeline().getFramesInFlight(); }
 
 	void run(){
 		windowHandler = new WindowHandler();
 		GLFWwindow* window = windowHandler->getWindowPointer();
         glfwSetWindowUserPointer(window, this);
 		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+		glfwSetKeyCallback(window, keyCallback);
 		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); //FPS camera input
     	glfwSetCursorPosCallback(window, mouse_callback);
 
@@ -163,23 +185,41 @@ private:
 	SurfaceHandler* surfaceHandler;
     DeviceHandler* deviceHandler;
 	SwapchainHandler* swapchainHandler;
-	RenderPassHandler* renderPassHandler;
+	RenderGraph* renderGraph;
+	uint32_t forwardPass;
 	//UniformBuffers* uniformBuffers;
 	DescriptorSetsHandler* descriptorSets;
 	GraphicsPipelineHandler* graphicsPipelineHandler;
 	CommandBuffersHandler* commandBuffersHandler;
+	CommandBufferCache* commandBufferCache;
+	uint32_t recordedMoveCount = 0; //defragmenter moves the cached recordings have seen, a moved buffer means they bind a stale one
+	ParallelHelpers::ThreadPool* threadPool;
+	SecondaryCommandBuffersHandler* secondaryCommandBuffers;
 
 	TextureHandler* texture;
 	ModelHandler* model;
+	TextureResidencyManager* residencyManager;
+	MemoryBudgetHandler* memoryBudget;
+	MemoryDefragmenter* defragmenter;
+#ifdef ENABLE_VIRTUAL_TEXTURING
+	VirtualTextureHandler* virtualTexture;
+	GraphicsPipelineHandler* feedbackPipelineHandler;
+	uint32_t feedbackPass;
+#endif
+#ifdef ENABLE_TEXTURE_ARRAYS
+	TextureArrayHandler* textureArray;
+#endif
 
 	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
+	MemoryAllocation vertexBufferAllocation;
 	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	MemoryAllocation indexBufferAllocation;
 
+	std::vector<DrawCommand> draws; //the main pass records these split across the thread pool
+
+	//binary, only because the swapchain takes nothing else; frames are paced on the device's FrameTimeline
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores; //
-	std::vector<VkFence> inFlightFences; //used to block host while gpu is rendering the previous frame
 
 	void mainLoop(){
 		while(!glfwWindowShouldClose(windowHandler->getWindowPointer())){
@@ -197,19 +237,62 @@ private:
 		VkDevice& logicalDevice = deviceHandler->getLogicalDevice();
 
 		swapchainHandler = new SwapchainHandler(windowHandler, surfaceHandler, deviceHandler);
-		renderPassHandler = new RenderPassHandler(logicalDevice, swapchainHandler->getSwapchainImageFormat(), swapchainHandler->findDepthFormat());
-		swapchainHandler->createInitialFrameBuffers(renderPassHandler);
-		
+
 		commandBuffersHandler = new CommandBuffersHandler(deviceHandler);
+		commandBufferCache = new CommandBufferCache(deviceHandler, deviceHandler->getFrameTimeline().getFramesInFlight(), swapchainHandler->getImageCount());
+		threadPool = new ParallelHelpers::ThreadPool();
+		secondaryCommandBuffers = new SecondaryCommandBuffersHandler(deviceHandler, threadPool, commandBufferCache->getSlotCount());
+		commandBuffersHandler->beginUploadBatch(); //every startup upload goes out in one submit
+		defragmenter = new MemoryDefragmenter(deviceHandler, commandBuffersHandler);
 		camera = new Camera(deviceHandler, swapchainHandler);
-		texture = new TextureHandler(TEXTURE_PATH, deviceHandler, commandBuffersHandler);
-		descriptorSets = new DescriptorSetsHandler(logicalDevice, camera->uniformBuffers, texture);
-		
-		graphicsPipelineHandler = new GraphicsPipelineHandler(logicalDevice, swapchainHandler, descriptorSets->getDescriptorSetLayout(), renderPassHandler->getRenderPass());
+		texture = TextureHandler::LoadTextures({TEXTURE_PATH}, deviceHandler, commandBuffersHandler).front(); //add paths here to decode more textures in parallel
 		model = new ModelHandler(MODEL_PATH);
+#ifdef ENABLE_VIRTUAL_TEXTURING
+		virtualTexture = new VirtualTextureHandler(VIRTUAL_TEXTURE_PATH, TEXTURE_PATH, deviceHandler, commandBuffersHandler, swapchainHandler->getSwapchainExtent());
+		descriptorSets = new DescriptorSetsHandler(logicalDevice, camera->uniformBuffers, virtualTexture->getCacheImageView(), virtualTexture->getCacheSampler(), virtualTexture);
+		residencyManager = new TextureResidencyManager(deviceHandler, commandBuffersHandler, descriptorSets, TEXTURE_MEMORY_BUDGET); //nothing registered, the page cache replaces the texture
+		const char* fragShaderPath = "shaders/frag_vt.spv";
+#elif defined(ENABLE_BINDLESS_TEXTURES)
+		descriptorSets = new DescriptorSetsHandler(logicalDevice, camera->uniformBuffers, BINDLESS_TEXTURE_CAPACITY);
+		model->getTextureSlot().textureIndex = descriptorSets->registerTexture(texture->getTextureImageView(), texture->getTextureSampler());
+		residencyManager = new TextureResidencyManager(deviceHandler, commandBuffersHandler, descriptorSets, TEXTURE_MEMORY_BUDGET);
+		residencyManager->registerTexture(texture, glm::vec3(0.0f), 1.5f, model->getTextureSlot().textureIndex);
+		defragmenter->registerMovable(&texture->getAllocation(), [this](VkCommandBuffer commandBuffer){ return residencyManager->relocate(texture, commandBuffer); });
+		const char* fragShaderPath = "shaders/frag_bindless.spv";
+#elif defined(ENABLE_TEXTURE_ARRAYS)
+		textureArray = new TextureArrayHandler({TEXTURE_PATH}, TEXTURE_ARRAY_LAYER_SIZE, deviceHandler, commandBuffersHandler);
+		model->setTextureSlot(textureArray->getSlot(0));
+		descriptorSets = new DescriptorSetsHandler(logicalDevice, camera->uniformBuffers, textureArray->getTextureImageView(), textureArray->getTextureSampler());
+		residencyManager = new TextureResidencyManager(deviceHandler, commandBuffersHandler, descriptorSets, TEXTURE_MEMORY_BUDGET); //nothing registered, the array replaces the texture
+		const char* fragShaderPath = "shaders/frag_array.spv";
+#else
+		descriptorSets = new DescriptorSetsHandler(logicalDevice, camera->uniformBuffers, texture->getTextureImageView(), texture->getTextureSampler());
+		residencyManager = new TextureResidencyManager(deviceHandler, commandBuffersHandler, descriptorSets, TEXTURE_MEMORY_BUDGET);
+		residencyManager->registerTexture(texture, glm::vec3(0.0f), 1.5f); //the viking room model fits in a sphere of about this radius around the origin
+		defragmenter->registerMovable(&texture->getAllocation(), [this](VkCommandBuffer commandBuffer){ return residencyManager->relocate(texture, commandBuffer); });
+		const char* fragShaderPath = "shaders/frag.spv";
+#endif
+		createRenderGraph(); //pipelines are created against its render passes
+		graphicsPipelineHandler = new GraphicsPipelineHandler(logicalDevice, swapchainHandler, descriptorSets->getSetLayouts(), renderGraph->getRenderPass(forwardPass), "shaders/vert.spv", fragShaderPath);
+#ifdef ENABLE_VIRTUAL_TEXTURING
+		feedbackPipelineHandler = new GraphicsPipelineHandler(logicalDevice, swapchainHandler, descriptorSets->getSetLayouts(), renderGraph->getRenderPass(feedbackPass), "shaders/vert.spv", "shaders/vt_feedback.spv");
+#endif
+		memoryBudget = new MemoryBudgetHandler(deviceHandler);
+		memoryBudget->addOverBudgetCallback([this](uint32_t heap, const HeapBudget& state){
+			if(!(state.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) return;
+
+			//textures are what can give memory back, shrink their budget by the overshoot
+			VkDeviceSize over = state.usage - state.budget;
+			VkDeviceSize resident = residencyManager->getResidentBytes();
+			residencyManager->setBudget(std::min(residencyManager->getBudget(), resident > over ? resident - over : 0));
+			if(DEBUG) std::cout << "Heap " << heap << " over budget by " << (over >> 20) << " MiB, texture budget now " << (residencyManager->getBudget() >> 20) << " MiB\n";
+		});
+
 		createVertexBuffer();
 		createIndexBuffer();
-		createSyncObjects();
+		draws.push_back({static_cast<uint32_t>(model->getIndicesDataSize()), 0, model->getTextureSlot()});
+		commandBuffersHandler->waitForUploads(commandBuffersHandler->submitUploadBatch());
+		createSyncObjects(deviceHandler->getFrameTimeline().getFramesInFlight());
 
 		if(DEBUG) std::cout << "Vulkan Successfully Initialized.\n";		
 	}
@@ -217,26 +300,35 @@ private:
 	void cleanup(){
 		VkDevice& device = deviceHandler->getLogicalDevice();
 
+		deviceHandler->getDeletionQueue().flush(); //retired objects may use the handlers deleted below
+
+		delete renderGraph; //its framebuffers reference swapchain image views
 		delete swapchainHandler;
 		delete graphicsPipelineHandler;
-		delete renderPassHandler;
+#ifdef ENABLE_VIRTUAL_TEXTURING
+		delete feedbackPipelineHandler;
+		delete virtualTexture;
+#endif
+#ifdef ENABLE_TEXTURE_ARRAYS
+		delete textureArray;
+#endif
 		delete camera;
 		//delete uniformBuffers;
+		delete memoryBudget;
+		delete defragmenter;
+		delete residencyManager;
 		delete descriptorSets;
 		delete model;
 		delete texture;
 		
-		vkDestroyBuffer(device, vertexBuffer, nullptr);
-		vkFreeMemory(device, vertexBufferMemory, nullptr);
-		vkDestroyBuffer(device, indexBuffer, nullptr);
-		vkFreeMemory(device, indexBufferMemory, nullptr);
+		BufferHelpers::DestroyBuffer(vertexBuffer, vertexBufferAllocation, deviceHandler);
+		BufferHelpers::DestroyBuffer(indexBuffer, indexBufferAllocation, deviceHandler);
 
-		for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){	
-			vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-			vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-			vkDestroyFence(device, inFlightFences[i], nullptr);
-		}
+		destroySyncObjects(0);
 
+		delete secondaryCommandBuffers;
+		delete threadPool;
+		delete commandBufferCache;
 		delete commandBuffersHandler;
 		delete deviceHandler;
 		delete surfaceHandler; //surface must be deleted before the instance
@@ -249,94 +341,201 @@ private:
 	void createVertexBuffer(){
 		VkDeviceSize bufferSize = sizeof(*model->getVertexData()) * model->getVertexDataSize();
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		BufferHelpers::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, deviceHandler);
-
-        VkDevice& device = deviceHandler->getLogicalDevice();
-
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, model->getVertexData(), (size_t) bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
+		VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT; //transfer source so the defragmenter can copy it
 
-		BufferHelpers::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory, deviceHandler);
-
-		BufferHelpers::CopyBuffer(stagingBuffer, vertexBuffer, bufferSize, commandBuffersHandler);
-
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		BufferHelpers::CreateBufferWithData(model->getVertexData(), bufferSize, usage, vertexBuffer, vertexBufferAllocation, deviceHandler, commandBuffersHandler);
+		defragmenter->registerBuffer(vertexBuffer, vertexBufferAllocation, bufferSize, usage);
 	}
 
 	void createIndexBuffer(){
 		VkDeviceSize bufferSize = sizeof(*model->getIndicesData()) * model->getIndicesDataSize();
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		BufferHelpers::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, deviceHandler);
-
-        VkDevice& device = deviceHandler->getLogicalDevice();
-
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, model->getIndicesData(), (size_t) bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
+		VkBufferUsageFlags usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 
-		BufferHelpers::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory, deviceHandler);
-		BufferHelpers::CopyBuffer(stagingBuffer, indexBuffer, bufferSize, commandBuffersHandler);
-		
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		BufferHelpers::CreateBufferWithData(model->getIndicesData(), bufferSize, usage, indexBuffer, indexBufferAllocation, deviceHandler, commandBuffersHandler);
+		defragmenter->registerBuffer(indexBuffer, indexBufferAllocation, bufferSize, usage);
 	}
 
-	void createSyncObjects(){
-		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+	//creates the semaphores of the frame slots from the current count up to count
+	void createSyncObjects(uint32_t count){
+		size_t first = imageAvailableSemaphores.size();
+		imageAvailableSemaphores.resize(count);
+		renderFinishedSemaphores.resize(count);
 
 		VkSemaphoreCreateInfo semaphoreInfo{};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; //so the first frame isn't waiting for a previous (nonexistant) frame to finish rendering
-
         VkDevice& device = deviceHandler->getLogicalDevice();
 
-		for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){
+		for(size_t i = first; i < count; ++i){
 			if(
 				vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-				vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS
+				vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS
 			) throw std::runtime_error ("Failed to create semaphores.\n");
 		}
 		
 	}
 
+	void destroySyncObjects(size_t first){
+		VkDevice& device = deviceHandler->getLogicalDevice();
+
+		for(size_t i = first; i < imageAvailableSemaphores.size(); ++i){
+			vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+			vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+		}
+		imageAvailableSemaphores.resize(first);
+		renderFinishedSemaphores.resize(first);
+	}
+
+	//the frame as passes over the resources they read and write, the graph derives render passes, barriers and transient memory from it
+	//VT feedback -> readback -> forward; without a readback nothing uses the feedback and the graph culls it
+	void createRenderGraph(){
+		renderGraph = new RenderGraph(deviceHandler, swapchainHandler->getSwapchainExtent());
+
+		VkFormat depthFormat = swapchainHandler->findDepthFormat();
+		uint32_t swapchainImage = renderGraph->importImage("swapchain", swapchainHandler->getSwapchainImageFormat(), VK_IMAGE_ASPECT_COLOR_BIT, GRAPH_INDEX_IMAGE,
+			swapchainHandler->getSwapchainImages(), swapchainHandler->getSwapchainImageViews(), swapchainHandler->getSwapchainExtent(), GRAPH_USAGE_PRESENT);
+		uint32_t depth = renderGraph->createImage("depth", depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+		VkClearValue clearColor{};
+		clearColor.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+		VkClearValue clearDepth{};
+		clearDepth.depthStencil = {1.0f, 0}; //default the depth values at each pixel to the farthest depth away (far plane)
+
+#ifdef ENABLE_VIRTUAL_TEXTURING
+		uint32_t feedback = renderGraph->importImage("vt feedback", VK_FORMAT_R8G8B8A8_UINT, VK_IMAGE_ASPECT_COLOR_BIT, GRAPH_INDEX_FRAME,
+			virtualTexture->getFeedbackImages(), virtualTexture->getFeedbackImageViews(), virtualTexture->getFeedbackExtent());
+		uint32_t feedbackDepth = renderGraph->createImage("vt feedback depth", depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, virtualTexture->getFeedbackExtent());
+		uint32_t readback = renderGraph->importBuffer("vt readback", GRAPH_INDEX_FRAME, virtualTexture->getReadbackBuffers(), GRAPH_USAGE_HOST_READ);
+
+		feedbackPass = renderGraph->addGraphicsPass("vt feedback", [this](VkCommandBuffer commandBuffer, const RenderGraph::Context& context){ recordFeedbackPass(commandBuffer, context); });
+		VkClearValue noRequest{}; //0 in the last channel means no request
+		renderGraph->addColorAttachment(feedbackPass, feedback, true, noRequest);
+		renderGraph->addDepthAttachment(feedbackPass, feedbackDepth, true, clearDepth);
+
+		uint32_t readbackPass = renderGraph->addPass("vt readback", [this](VkCommandBuffer commandBuffer, const RenderGraph::Context& context){ virtualTexture->recordFeedbackReadback(commandBuffer, context.frame); });
+		renderGraph->use(readbackPass, feedback, GRAPH_USAGE_TRANSFER_SRC);
+		renderGraph->use(readbackPass, readback, GRAPH_USAGE_TRANSFER_DST);
+#endif
+
+		//the draws themselves are recorded into secondaries in parallel, the primary only executes them
+		forwardPass = renderGraph->addGraphicsPass("forward", [this](VkCommandBuffer commandBuffer, const RenderGraph::Context& context){
+			secondaryCommandBuffers->recordDraws(commandBuffer, commandBufferCache->getSlot(context.frame, context.image), context.renderPass, context.framebuffer, draws.size(),
+				[this](VkCommandBuffer secondary, size_t first, size_t end){ recordDrawRange(secondary, first, end); });
+		}, true);
+		renderGraph->addColorAttachment(forwardPass, swapchainImage, true, clearColor);
+		renderGraph->addDepthAttachment(forwardPass, depth, true, clearDepth);
+
+		renderGraph->compile(deviceHandler->getFrameTimeline().getFramesInFlight(), swapchainHandler->getImageCount());
+	}
+
+	//resizes every per frame resource array to count slots, waiting for the device to go idle first
+	//a rare, user triggered change, so it takes the simple route: nothing is in flight while arrays shrink or grow
+	void setFramesInFlight(uint32_t count){
+		count = std::clamp(count, 1u, FRAMES_IN_FLIGHT_LIMIT);
+		FrameTimeline& timeline = deviceHandler->getFrameTimeline();
+		if(count == timeline.getFramesInFlight()) return;
+
+		vkDeviceWaitIdle(deviceHandler->getLogicalDevice());
+		deviceHandler->getDeletionQueue().flush(); //the device is idle anyway, nothing retired has to wait for the frame slots renumbered below
+		timeline.setFramesInFlight(count);
+
+		resizeRecordings();
+		camera->uniformBuffers->setFrameCount(count);
+		descriptorSets->setFrameCount(count); //after the uniform buffers, new sets point into them
+#ifdef ENABLE_VIRTUAL_TEXTURING
+		virtualTexture->setFrameCount(count);
+#endif
+		renderGraph->rebuild(count, swapchainHandler->getImageCount()); //after everything it imports per frame
+		if(count < imageAvailableSemaphores.size()) destroySyncObjects(count);
+		else createSyncObjects(count);
+
+		currentFrame = 0;
+		if(DEBUG) std::cout << "Frames in flight: " << count << '\n';
+	}
+
+	//one cached recording per frame in flight and swapchain image, all of them recorded anew
+	void resizeRecordings(){
+		commandBufferCache->resize(deviceHandler->getFrameTimeline().getFramesInFlight(), swapchainHandler->getImageCount());
+		secondaryCommandBuffers->setSlotCount(commandBufferCache->getSlotCount());
+	}
+
+	void recreateSwapchain(){
+		swapchainHandler->recreateSwapchain(); //frames in flight finish on the old swapchain and targets, which are retired
+		renderGraph->rebuild(deviceHandler->getFrameTimeline().getFramesInFlight(), swapchainHandler->getImageCount());
+		resizeRecordings(); //framebuffers, extent and possibly the image count changed
+	}
+
 	void drawFrame() {
 		VkDevice& device = deviceHandler->getLogicalDevice();
+		FrameTimeline& timeline = deviceHandler->getFrameTimeline();
+		DeletionQueue& deletionQueue = deviceHandler->getDeletionQueue();
+
+		//a frame is steady when it changed nothing: its recording is reused and nothing is retired, streamed or resized; those must not allocate
+		AllocationTracker::beginFrame();
+		bool steady = true;
 
-        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+		if(requestedFramesInFlight != 0){
+			setFramesInFlight(requestedFramesInFlight);
+			requestedFramesInFlight = 0;
+			steady = false;
+		}
+		uint32_t framesInFlight = timeline.getFramesInFlight();
+
+		//the frame that last used this slot's resources, frames before the first count as finished
+		uint64_t frameNumber = timeline.getCurrentFrame();
+		if(frameNumber > framesInFlight) timeline.waitForFrame(frameNumber - framesInFlight);
+		deletionQueue.collect();
+		size_t pendingDeletions = deletionQueue.getPendingCount();
 
         uint32_t imageIndex;
         VkResult result = vkAcquireNextImageKHR(device, swapchainHandler->getSwapchain(), UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-            swapchainHandler->recreateSwapchain();
+            recreateSwapchain();
+            AllocationTracker::endFrame(false);
             return;
         } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
             throw std::runtime_error("failed to acquire swap chain image!");
         }
 
+        AllocationTracker::setPhase(FRAME_PHASE_UPDATE);
+		uint64_t residencyChangeCount = residencyManager->getChangeCount();
+#ifdef ENABLE_VIRTUAL_TEXTURING
+		uint64_t pageChangeCount = virtualTexture->getPageChangeCount();
+#endif
         //uniformBuffers->updateUniformBuffer(currentFrame);
 		processInput(windowHandler->getWindowPointer());
+		camera->uniformBuffers->reset(currentFrame); //the wait above guarantees the frame's previous slices are no longer read
 		camera->Update(currentFrame);
+		descriptorSets->update();
+		defragmenter->update(); //before the residency manager, which repoints descriptors at moved textures
+		residencyManager->update(currentFrame, camera->ubo.view, camera->ubo.projection, static_cast<float>(swapchainHandler->getSwapchainExtent().height));
+#ifdef ENABLE_VIRTUAL_TEXTURING
+		virtualTexture->update(currentFrame);
+#endif
+		memoryBudget->update();
+
+        if(defragmenter->getMoveCount() != recordedMoveCount){
+			recordedMoveCount = defragmenter->getMoveCount();
+			commandBufferCache->invalidate();
+		}
 
-        vkResetFences(device, 1, &inFlightFences[currentFrame]);
-
-        vkResetCommandBuffer(commandBuffersHandler->GetCommandBuffers()[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
-        recordCommandBuffer(commandBuffersHandler->GetCommandBuffers()[currentFrame], imageIndex);
-
+		if(residencyManager->getChangeCount() != residencyChangeCount) steady = false;
+#ifdef ENABLE_VIRTUAL_TEXTURING
+		if(virtualTexture->getPageChangeCount() != pageChangeCount) steady = false;
+#endif
+
+		AllocationTracker::setPhase(FRAME_PHASE_RECORD);
+		uint64_t reuseCount = commandBufferCache->getReuseCount();
+		//the recording of this slot and image is reused unless the descriptors or uniform offset it bound changed, or transfers need acquiring
+		bool mustRecord = commandBuffersHandler->hasPendingAcquires();
+		if(!mustRecord) commandBuffersHandler->reclaimUploads(); //recordPendingAcquires does it otherwise
+		VkCommandBuffer commandBuffer = commandBufferCache->get(currentFrame, imageIndex, descriptorSets->getVersion(), camera->uboOffset, mustRecord,
+			[this, imageIndex](VkCommandBuffer commandBuffer){ return recordCommandBuffer(commandBuffer, imageIndex); });
+		if(commandBufferCache->getReuseCount() == reuseCount) steady = false;
+
+        AllocationTracker::setPhase(FRAME_PHASE_SUBMIT);
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -347,14 +546,27 @@ private:
         submitInfo.pWaitDstStageMask = waitStages;
 
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffersHandler->GetCommandBuffers()[currentFrame];
+        submitInfo.pCommandBuffers = &commandBuffer;
 
-        VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-        submitInfo.signalSemaphoreCount = 1;
+        //the binary one is for presentation, the timeline one marks the frame finished
+        VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame], timeline.getSemaphore()};
+        submitInfo.signalSemaphoreCount = 2;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        if (vkQueueSubmit(deviceHandler->getGraphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+        uint64_t waitValues[] = {0}; //ignored for binary semaphores
+        uint64_t signalValues[] = {0, frameNumber};
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+        timelineInfo.signalSemaphoreValueCount = 2;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
+        submitInfo.pNext = &timelineInfo;
+
+        if (vkQueueSubmit(deviceHandler->getGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
 			throw std::runtime_error("failed to submit draw command buffer!");
+        timeline.markSubmitted();
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -372,15 +584,20 @@ private:
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
             framebufferResized = false;
-            swapchainHandler->recreateSwapchain();
+            recreateSwapchain();
+            steady = false;
         } else if (result != VK_SUCCESS) {
             throw std::runtime_error("failed to present swap chain image!");
         }
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        currentFrame = (currentFrame + 1) % framesInFlight;
+
+        if(deletionQueue.getPendingCount() != pendingDeletions) steady = false;
+        AllocationTracker::endFrame(steady);
     }
 
-	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex){
+	//records the whole frame for the current frame slot and imageIndex, returns whether it may be submitted again by later frames
+	bool recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex){
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		//optional
@@ -389,24 +606,16 @@ private:
 
 		if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) throw std::runtime_error("Failed to beign recording command buffer.\n");
 
-		VkRenderPassBeginInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPassHandler->getRenderPass();
-		renderPassInfo.framebuffer = swapchainHandler->getSwapchainFramebuffers()[imageIndex];
-		renderPassInfo.renderArea.offset = {0, 0};
-		renderPassInfo.renderArea.extent = swapchainHandler->getSwapchainExtent();
-		
-		std::array<VkClearValue, 2> clearValues{};
-		clearValues[0] = {{0.0f, 0.0f, 0.0f, 1.0f}}; //color attachments
-		clearValues[1] = {1.0f, 0}; //default the depth values at each pixel to the farthest depth away (far plane)
+		bool acquired = commandBuffersHandler->recordPendingAcquires(commandBuffer); //resources streamed in on the transfer queue become usable from here on
 
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-		renderPassInfo.pClearValues = clearValues.data();
+		renderGraph->execute(commandBuffer, currentFrame, imageIndex);
 
-		//to commandBuffer, record a BeginRenderPass command, using &renderPassInfo, into a primary command buffer
-		//all vkCmd functions return void; error handling is done after recording
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) throw std::runtime_error("Failed to record command buffer!\n");
+		return !acquired; //ownership is acquired once, replaying the barriers would be invalid
+	}
 
+	//records draws [first, end) of the main pass into a secondary command buffer; runs on a worker thread, so it only reads renderer state
+	void recordDrawRange(VkCommandBuffer commandBuffer, size_t first, size_t end){
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineHandler->getGraphicsPipeline());
 
 		VkBuffer vertexBuffers[] = {vertexBuffer};
@@ -414,7 +623,7 @@ private:
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-		//these are the dynamic state things specified when creating the pipeline:
+		//these are the dynamic state things specified when creating the pipeline, secondaries inherit none of it:
 		VkViewport viewport{};
 		viewport.x = 0.0f;
 		viewport.y = 0.0f;
@@ -429,16 +638,54 @@ private:
 		scissor.extent = swapchainHandler->getSwapchainExtent();
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineHandler->getPipelineLayout(), 0, 1, &descriptorSets->getDescriptorSets()[currentFrame], 0, nullptr);
-		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(model->getIndicesDataSize()), 1, 0, 0, 0);
+		descriptorSets->bind(commandBuffer, graphicsPipelineHandler->getPipelineLayout(), currentFrame, camera->uboOffset);
 
-		vkCmdEndRenderPass(commandBuffer);
+		for(size_t i = first; i < end; ++i){
+			vkCmdPushConstants(commandBuffer, graphicsPipelineHandler->getPipelineLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(TextureSlot), &draws[i].textureSlot);
+			vkCmdDrawIndexed(commandBuffer, draws[i].indexCount, 1, draws[i].firstIndex, 0, 0);
+		}
+	}
 
-		if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) throw std::runtime_error("Failed to record command buffer!\n");
+#ifdef ENABLE_VIRTUAL_TEXTURING
+	//draws the scene at low resolution writing which virtual texture pages each pixel needs, the graph has the readback pass copy that out for the cpu
+	void recordFeedbackPass(VkCommandBuffer commandBuffer, const RenderGraph::Context& context){
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, feedbackPipelineHandler->getGraphicsPipeline());
+
+		VkBuffer vertexBuffers[] = {vertexBuffer};
+		VkDeviceSize offsets[] = {0};
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(context.extent.width);
+		viewport.height = static_cast<float>(context.extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor{};
+		scissor.offset = {0, 0};
+		scissor.extent = context.extent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		descriptorSets->bind(commandBuffer, feedbackPipelineHandler->getPipelineLayout(), context.frame, camera->uboOffset);
+		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(model->getIndicesDataSize()), 1, 0, 0, 0);
 	}
+#endif
 };
 
 static void framebufferResizeCallback(GLFWwindow* window, int width, int height){
     Renderer* renderer = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
     renderer->framebufferResized = true; //let the renderer know the framebuffer was resized
-}
\ No newline at end of file
+}
+
+//F cycles the frames in flight setting through 1 .. FRAMES_IN_FLIGHT_LIMIT
+static void keyCallback(GLFWwindow* window, int key, int, int action, int){
+    if(key != GLFW_KEY_F || action != GLFW_PRESS) return;
+
+    Renderer* renderer = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
+    uint32_t current = renderer->requestedFramesInFlight != 0 ? renderer->requestedFramesInFlight : renderer->getFramesInFlight();
+    renderer->requestedFramesInFlight = current % FRAMES_IN_FLIGHT_LIMIT + 1;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <stdexcept>
+
+#include "Globals.h"
+#include "DeviceHandler.h"
+#include "ParallelHelpers.h"
+
+//records the draws of a render pass in parallel: every thread of the pool fills a secondary command buffer of its own
+//pools are per recording slot and per thread, command pools must never be used from two threads at once
+//a slot is one cached frame command buffer (see CommandBufferCache), its secondaries are executed again whenever it is
+class SecondaryCommandBuffersHandler{
+    std::vector<std::vector<VkCommandPool>> commandPools; //[slot][thread]
+    std::vector<std::vector<VkCommandBuffer>> commandBuffers; //[slot][thread], one secondary allocated from each pool
+    std::vector<VkCommandBuffer> recorded; //secondaries filled by the last recordDraws, in draw order
+
+    ParallelHelpers::ThreadPool* threadPool;
+    DeviceHandler* deviceHandler;
+
+public:
+    SecondaryCommandBuffersHandler(DeviceHandler*& _dh, ParallelHelpers::ThreadPool* _threadPool, uint32_t slotCount) : threadPool(_threadPool), deviceHandler(_dh){
+        createCommandPools(slotCount);
+        recorded.reserve(threadPool->getThreadCount());
+    }
+
+    ~SecondaryCommandBuffersHandler(){
+        destroyCommandPools(0);
+    }
+
+    //pools for count recording slots, frames may still be executing
+    //slots map to other frames and images once the count changes, so every pool is retired and replaced rather than reused
+    void setSlotCount(uint32_t count){
+        if(count == commandPools.size()) return;
+
+        retireCommandPools();
+        createCommandPools(count);
+    }
+
+    //splits drawCount draws into contiguous ranges, one per thread, and has recordRange(commandBuffer, first, end) record draws [first, end) into each
+    //commandBuffer is already begun inside subpass 0 of renderPass, so recordRange binds its own state and only draws
+    //primary must have begun renderPass on framebuffer with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS; the secondaries are executed into it in order
+    //the frame that last submitted this slot must have finished, its pools are reset here
+    template<typename RecordRange>
+    void recordDraws(VkCommandBuffer primary, uint32_t slot, VkRenderPass renderPass, VkFramebuffer framebuffer, size_t drawCount, const RecordRange& recordRange){
+        //a thread of its own only pays off for enough draws, a handful of them are recorded on the calling thread alone
+        size_t wanted = (drawCount + DRAWS_PER_RECORDING_THREAD - 1) / DRAWS_PER_RECORDING_THREAD;
+        uint32_t threadCount = static_cast<uint32_t>(std::clamp<size_t>(wanted, 1, threadPool->getThreadCount()));
+
+        recorded.resize(threadCount);
+        threadPool->run(threadCount, [&](uint32_t thread){
+            VkCommandBuffer commandBuffer = commandBuffers[slot][thread];
+            vkResetCommandPool(deviceHandler->getLogicalDevice(), commandPools[slot][thread], 0);
+
+            VkCommandBufferInheritanceInfo inheritanceInfo{};
+            inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritanceInfo.renderPass = renderPass;
+            inheritanceInfo.subpass = 0;
+            inheritanceInfo.framebuffer = framebuffer;
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT; //submitted again for as long as the primary is
+            beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+            if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) throw std::runtime_error("Failed to begin recording secondary command buffer.\n");
+
+            recordRange(commandBuffer, drawCount * thread / threadCount, drawCount * (thread + 1) / threadCount);
+
+            if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) throw std::runtime_error("Failed to record secondary command buffer.\n");
+            recorded[thread] = commandBuffer;
+        });
+
+        vkCmdExecuteCommands(primary, static_cast<uint32_t>(recorded.size()), recorded.data());
+    }
+
+private:
+    void retireCommandPools(){
+        DeviceHandler* dh = deviceHandler;
+        std::vector<std::vector<VkCommandPool>> pools;
+        pools.swap(commandPools);
+        commandBuffers.clear();
+
+        dh->getDeletionQueue().retire([dh, pools](){
+            for(auto& slotPools : pools){
+                for(VkCommandPool pool : slotPools) vkDestroyCommandPool(dh->getLogicalDevice(), pool, nullptr); //frees its secondary too
+            }
+        });
+    }
+
+    //destroys the pools of every slot from first on
+    void destroyCommandPools(size_t first){
+        for(size_t slot = first; slot < commandPools.size(); ++slot){
+            for(VkCommandPool pool : commandPools[slot]) vkDestroyCommandPool(deviceHandler->getLogicalDevice(), pool, nullptr); //frees its secondary too
+        }
+        commandPools.resize(first);
+        commandBuffers.resize(first);
+    }
+
+    //creates the pools of the slots from the current count up to count
+    void createCommandPools(uint32_t count){
+        uint32_t threadCount = threadPool->getThreadCount();
+        uint32_t first = static_cast<uint32_t>(commandPools.size());
+        commandPools.resize(count, std::vector<VkCommandPool>(threadCount));
+        commandBuffers.resize(count, std::vector<VkCommandBuffer>(threadCount));
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; //rerecorded whenever the scene changes, reset a whole pool at a time
+        poolInfo.queueFamilyIndex = deviceHandler->getQueueFamilyIndices().graphicsFamily.value();
+
+        for(uint32_t slot = first; slot < count; ++slot){
+            for(uint32_t thread = 0; thread < threadCount; ++thread){
+                if(vkCreateCommandPool(deviceHandler->getLogicalDevice(), &poolInfo, nullptr, &commandPools[slot][thread]) != VK_SUCCESS) throw std::runtime_error("Failed to create secondary command pool.\n");
+
+                VkCommandBufferAllocateInfo allocInfo{};
+                allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocInfo.commandPool = commandPools[slot][thread];
+                allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocInfo.commandBufferCount = 1;
+
+                if(vkAllocateCommandBuffers(deviceHandler->getLogicalDevice(), &allocInfo, &commandBuffers[slot][thread]) != VK_SUCCESS) throw std::runtime_error("Could not allocate secondary command buffers.\n");
+            }
+        }
+    }
+};
@@ -8,6 +8,7 @@
 #include <fstream>
 #include <iostream>
 #include "Globals.h"
+#include "VulkanDispatch.h"
 
 class ShaderHandler{
     VkShaderModule vertShaderModule;
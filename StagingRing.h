@@ -0,0 +1,176 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Globals.h"
+#include "DeviceHandler.h"
+
+//space handed out by the staging ring, valid until the submit that reads it has finished
+struct StagingRegion{
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    unsigned char* mapped; //already points at offset
+};
+
+//one persistently mapped host visible buffer all uploads are staged through
+//producers reserve space, write it and record copies from it; the space is reclaimed once the fence of the submit that read it signals
+class StagingRing{
+    //a standalone buffer for an upload that does not fit the ring, freed like ring space
+    struct OversizeBuffer{
+        VkBuffer buffer;
+        MemoryAllocation allocation;
+    };
+
+    //everything reserved up to end was read by the submit that signals fence
+    struct InFlight{
+        VkFence fence;
+        VkDeviceSize end;
+        std::vector<OversizeBuffer> oversize;
+    };
+
+    VkBuffer ringBuffer;
+    MemoryAllocation ringAllocation;
+    unsigned char* ringMapped;
+    VkDeviceSize capacity;
+    VkDeviceSize minAlignment;
+
+    VkDeviceSize head = 0; //next free byte
+    VkDeviceSize tail = 0; //oldest byte still in use, head never catches up with it from behind
+    VkDeviceSize submittedEnd = 0; //head at the last markSubmitted, reservations past it have no fence yet
+    std::deque<InFlight> inFlight;
+    std::vector<OversizeBuffer> pendingOversize;
+
+    DeviceHandler* deviceHandler;
+
+public:
+    StagingRing(DeviceHandler*& _dh, VkDeviceSize _capacity) : capacity(_capacity), deviceHandler(_dh){
+        minAlignment = std::max<VkDeviceSize>(16, deviceHandler->getCapabilities().getLimits().optimalBufferCopyOffsetAlignment); //16 covers every texel size
+
+        createBuffer(capacity, ringBuffer, ringAllocation);
+        ringMapped = static_cast<unsigned char*>(ringAllocation.mapped);
+    }
+
+    ~StagingRing(){
+        for(auto& f : inFlight){
+            for(auto& o : f.oversize) destroyBuffer(o);
+        }
+        for(auto& o : pendingOversize) destroyBuffer(o);
+
+        vkDestroyBuffer(deviceHandler->getLogicalDevice(), ringBuffer, nullptr);
+        deviceHandler->getAllocator().free(ringAllocation);
+    }
+
+    //blocks on the oldest submits only when the ring is full of space they still read
+    StagingRegion reserve(VkDeviceSize size, VkDeviceSize alignment = 1){
+        alignment = std::max(alignment, minAlignment);
+
+        if(size >= capacity) return reserveOversize(size);
+
+        reclaim();
+        VkDeviceSize offset;
+        while(!fits(size, alignment, offset)){
+            if(inFlight.empty()) return reserveOversize(size); //the ring is taken by reservations not submitted yet, waiting would never free it
+
+            vkWaitForFences(deviceHandler->getLogicalDevice(), 1, &inFlight.front().fence, VK_TRUE, UINT64_MAX);
+            reclaim();
+        }
+
+        head = offset + size;
+
+        StagingRegion region{};
+        region.size = size;
+        region.buffer = ringBuffer;
+        region.offset = offset;
+        region.mapped = ringMapped + offset;
+        return region;
+    }
+
+    //everything reserved since the last call is read by the submit signalling fence, which must stay alive until reclaimed
+    void markSubmitted(VkFence fence){
+        if(head == submittedEnd && pendingOversize.empty()) return;
+
+        InFlight f{};
+        f.fence = fence;
+        f.end = head;
+        f.oversize.swap(pendingOversize);
+        inFlight.push_back(std::move(f));
+
+        submittedEnd = head;
+    }
+
+    //frees the space of every submit that has finished, in submission order
+    void reclaim(){
+        while(!inFlight.empty() && vkGetFenceStatus(deviceHandler->getLogicalDevice(), inFlight.front().fence) == VK_SUCCESS){
+            tail = inFlight.front().end;
+            for(auto& o : inFlight.front().oversize) destroyBuffer(o);
+            inFlight.pop_front();
+        }
+
+        //nothing in use anymore, start over at the beginning so large reservations don't have to wrap
+        if(inFlight.empty() && head == submittedEnd) head = tail = submittedEnd = 0;
+    }
+
+private:
+    StagingRegion reserveOversize(VkDeviceSize size){
+        OversizeBuffer oversize{};
+        createBuffer(size, oversize.buffer, oversize.allocation);
+        pendingOversize.push_back(oversize);
+
+        StagingRegion region{};
+        region.buffer = oversize.buffer;
+        region.offset = 0;
+        region.size = size;
+        region.mapped = static_cast<unsigned char*>(oversize.allocation.mapped);
+        return region;
+    }
+
+    bool fits(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset){
+        VkDeviceSize aligned = (head + alignment - 1) / alignment * alignment;
+
+        if(head >= tail){ //free space is [head, capacity) and [0, tail)
+            if(aligned + size <= capacity){
+                offset = aligned;
+                return true;
+            }
+            if(size < tail){
+                offset = 0;
+                return true;
+            }
+            return false;
+        }
+
+        //wrapped, free space is [head, tail)
+        if(aligned + size < tail){
+            offset = aligned;
+            return true;
+        }
+        return false;
+    }
+
+    void createBuffer(VkDeviceSize size, VkBuffer& buffer, MemoryAllocation& allocation){
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if(vkCreateBuffer(deviceHandler->getLogicalDevice(), &bufferInfo, nullptr, &buffer) != VK_SUCCESS) throw std::runtime_error("Failed to create staging buffer.\n");
+
+        //cached when available, the png decoder reads back what it writes
+        allocation = deviceHandler->getAllocator().allocateForBuffer(buffer, deviceHandler->getAllocator().getHostReadableFlags(), MEMORY_CATEGORY_STAGING);
+        vkBindBufferMemory(deviceHandler->getLogicalDevice(), buffer, allocation.memory, allocation.offset);
+    }
+
+    void destroyBuffer(OversizeBuffer& o){
+        vkDestroyBuffer(deviceHandler->getLogicalDevice(), o.buffer, nullptr);
+        deviceHandler->getAllocator().free(o.allocation);
+    }
+};
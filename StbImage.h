@@ -0,0 +1,5 @@
+#pragma once
+
+//the one place the stb_image implementation is compiled, include this instead of 3rdparty/stb_image.h
+#define STB_IMAGE_IMPLEMENTATION
+#include "3rdparty/stb_image.h"
@@ -4,8 +4,6 @@
 #include <GLFW/glfw3.h>
 //vulkan.h is loaded above
 
-class SwapchainHandler; //forward decl for DepthResourcesHandler
-
 #include <vector>
 #include <algorithm>
 
@@ -13,9 +11,7 @@ class SwapchainHandler; //forward decl for DepthResourcesHandler
 #include "WindowHandler.h"
 #include "DeviceHandler.h"
 #include "SurfaceHandler.h"
-#include "RenderPassHandler.h"
 #include "ImageHelpers.h"
-#include "DepthResourcesHandler.h"
 
 class SwapchainHandler{
     VkSwapchainKHR swapchain;
@@ -24,14 +20,9 @@ class SwapchainHandler{
 	VkFormat swapchainImageFormat;
 	VkExtent2D swapchainExtent;
 
-    std::vector<VkFramebuffer> swapchainFramebuffers;
-
-	DepthResourcesHandler* depthResourcesHandler;
-
     WindowHandler* windowHandler;
     SurfaceHandler* surfaceHandler;
     DeviceHandler* deviceHandler;
-    RenderPassHandler* renderPassHandler;
 	
 public:
 
@@ -40,19 +31,27 @@ public:
     {
         createSwapchain();
 		createImageViews();
-		depthResourcesHandler = new DepthResourcesHandler(deviceHandler, swapchainExtent);
     }
 
     ~SwapchainHandler(){
-		delete depthResourcesHandler; //should happen right before swapchain cleaned
         cleanupSwapchain();
     }
 
     inline VkSwapchainKHR& getSwapchain() { return swapchain; }
     inline VkFormat& getSwapchainImageFormat() { return swapchainImageFormat; }
     inline VkExtent2D& getSwapchainExtent() { return swapchainExtent; }
-    inline std::vector<VkFramebuffer>& getSwapchainFramebuffers(){ return swapchainFramebuffers; }
-	inline VkFormat findDepthFormat(){ return depthResourcesHandler->findDepthFormat(); }
+    inline std::vector<VkImage>& getSwapchainImages(){ return swapchainImages; }
+    inline std::vector<VkImageView>& getSwapchainImageViews(){ return swapchainImageViews; }
+    inline uint32_t getImageCount(){ return static_cast<uint32_t>(swapchainImages.size()); }
+
+	//the depth attachments of the render graph use it, they are transient and never sampled
+	VkFormat findDepthFormat(){
+		for(VkFormat format : {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT}){
+			if(deviceHandler->getCapabilities().supportsFormatFeatures(format, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)) return format;
+		}
+
+		throw std::runtime_error("Failed to find supported depth format.\n");
+	}
 
 	void recreateSwapchain(){
 		int width = 0, height = 0;
@@ -63,31 +62,32 @@ public:
 			glfwWaitEvents();
 		}
 
-		vkDeviceWaitIdle(deviceHandler->getLogicalDevice());
+		//frames still in flight keep presenting from the old swapchain, it and its views go once the next frame submitted has finished
+		//the frame timeline only covers rendering, not the presentation engine: without VK_EXT_swapchain_maintenance1 present fences
+		//nothing signals that the last present of the old swapchain is done, so this one rare path waits for the present queue to drain
+		vkQueueWaitIdle(deviceHandler->getPresentQueue());
+		VkSwapchainKHR oldSwapchain = swapchain;
+		std::vector<VkImageView> oldImageViews = swapchainImageViews;
 
-		cleanupSwapchain();
-		createSwapchain();
+		createSwapchain(oldSwapchain);
 		createImageViews();
-		delete depthResourcesHandler;
-		depthResourcesHandler = new DepthResourcesHandler(deviceHandler, swapchainExtent);
-		createFramebuffers();
+
+		DeviceHandler* dh = deviceHandler;
+		deviceHandler->getDeletionQueue().retire([dh, oldSwapchain, oldImageViews](){
+			for(auto imageView : oldImageViews) vkDestroyImageView(dh->getLogicalDevice(), imageView, nullptr);
+			vkDestroySwapchainKHR(dh->getLogicalDevice(), oldSwapchain, nullptr);
+		});
 	}
 
     void cleanupSwapchain(){
         VkDevice& device = deviceHandler->getLogicalDevice();
 
-		for(auto framebuffer : swapchainFramebuffers) vkDestroyFramebuffer(device, framebuffer, nullptr);
 		for(auto imageView : swapchainImageViews) vkDestroyImageView(device, imageView, nullptr);
 		vkDestroySwapchainKHR(device, swapchain, nullptr); //swapchain must be deleted before the surface
 	}
 
-    void createInitialFrameBuffers(RenderPassHandler*& _rph){
-		renderPassHandler = _rph;
-		createFramebuffers();
-    }
-
 private:
-    void createSwapchain(){
+    void createSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE){
 		SwapchainSupportDetails& swapchainSupport = deviceHandler->UpdateSwapchainSupportDetails();
 
 		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapchainSupport.formats);
@@ -130,7 +130,7 @@ private:
 		createInfo.presentMode = presentMode;
 		createInfo.clipped = VK_TRUE; //if another window blocks some pixels on the screen, don't render those pixels
 		
-		createInfo.oldSwapchain = VK_NULL_HANDLE; //if a swap chain becomes invalid/unoptimized and is completely recreated, the onld one must go here (for a complex reason)
+		createInfo.oldSwapchain = oldSwapchain; //the one being replaced, lets the presentation engine hand its resources over; it can no longer be acquired from
 
         VkDevice& device = deviceHandler->getLogicalDevice();
 
@@ -203,28 +203,4 @@ private:
 			swapchainImageViews[i] = ImageHelpers::CreateImageView(swapchainImages[i], swapchainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, deviceHandler->getLogicalDevice());
 		}
 	}
-
-	void createFramebuffers() {
-        swapchainFramebuffers.resize(swapchainImageViews.size());
-
-        for (size_t i = 0; i < swapchainImageViews.size(); i++) {
-            std::array<VkImageView, 2> attachments = {
-                swapchainImageViews[i],
-                depthResourcesHandler->getDepthImageView()
-            };
-
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPassHandler->getRenderPass();
-            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-            framebufferInfo.pAttachments = attachments.data();
-            framebufferInfo.width = swapchainExtent.width;
-            framebufferInfo.height = swapchainExtent.height;
-            framebufferInfo.layers = 1;
-
-            if (vkCreateFramebuffer(deviceHandler->getLogicalDevice(), &framebufferInfo, nullptr, &swapchainFramebuffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create framebuffer!");
-            }
-        }
-    }
 };
\ No newline at end of file
@@ -0,0 +1,213 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <memory>
+
+#include "ImageHelpers.h"
+#include "DeviceHandler.h"
+#include "CommandBuffersHandler.h"
+#include "StbImage.h"
+#include "ParallelHelpers.h"
+#include "TextureSlot.h"
+
+const uint32_t ATLAS_PADDING = 8; //texels of repeated edge around every atlas entry, keeps filtering and the first few mips from bleeding into neighbours
+
+//packs textures into the layers of one 2D array image, so they all share a single image view, sampler and descriptor
+//textures of exactly the layer size get a layer each, textures of at most half of it are packed together into atlas layers
+class TextureArrayHandler{
+    VkImage arrayImage;
+    MemoryAllocation arrayImageAllocation;
+    VkImageView arrayImageView;
+    VkSampler arraySampler;
+    uint32_t layerSize;
+    uint32_t layerCount;
+    uint32_t mipLevels;
+
+    std::vector<TextureSlot> slots; //one per path given, in the same order
+
+    DeviceHandler* deviceHandler;
+
+    struct DecodedTexture{
+        std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> pixels{nullptr, stbi_image_free}; //freed on every path out, including a failed decode of another entry
+        uint32_t width, height;
+        uint32_t x, y; //placement inside its layer
+    };
+
+public:
+    TextureArrayHandler(const std::vector<const char*>& paths, uint32_t _layerSize, DeviceHandler*& _dh, CommandBuffersHandler*& commandBuffersHandler) : layerSize(_layerSize), deviceHandler(_dh){
+        createArrayImage(paths, commandBuffersHandler);
+        arrayImageView = ImageHelpers::CreateImageView(arrayImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, deviceHandler->getLogicalDevice(), VK_IMAGE_VIEW_TYPE_2D_ARRAY, layerCount);
+        createSampler();
+    }
+
+    ~TextureArrayHandler(){
+        vkDestroySampler(deviceHandler->getLogicalDevice(), arraySampler, nullptr);
+        vkDestroyImageView(deviceHandler->getLogicalDevice(), arrayImageView, nullptr);
+        ImageHelpers::DestroyImage(arrayImage, arrayImageAllocation, deviceHandler);
+    }
+
+    inline VkImageView getTextureImageView(){ return arrayImageView; }
+    inline VkSampler getTextureSampler(){ return arraySampler; }
+    inline uint32_t getLayerCount(){ return layerCount; }
+    inline const TextureSlot& getSlot(size_t index){ return slots[index]; }
+
+private:
+    void createArrayImage(const std::vector<const char*>& paths, CommandBuffersHandler*& commandBuffersHandler){
+        if(paths.empty()) throw std::runtime_error("Texture array needs at least one texture.\n");
+
+        std::vector<DecodedTexture> textures(paths.size());
+        std::vector<size_t> fullLayers, atlased;
+
+        //entries need padding written around them, so they are decoded to the heap first, in parallel
+        ParallelHelpers::ParallelFor(paths.size(), [&](size_t i){
+            int width, height, channels;
+            textures[i].pixels.reset(stbi_load(paths[i], &width, &height, &channels, STBI_rgb_alpha));
+            if(!textures[i].pixels) throw std::runtime_error("failed to load texture image!");
+
+            textures[i].width = static_cast<uint32_t>(width);
+            textures[i].height = static_cast<uint32_t>(height);
+        });
+
+        for(size_t i = 0; i < paths.size(); ++i){
+            if(textures[i].width == layerSize && textures[i].height == layerSize) fullLayers.push_back(i);
+            else if(textures[i].width <= layerSize / 2 && textures[i].height <= layerSize / 2) atlased.push_back(i);
+            else throw std::runtime_error("Texture does not fit the texture array layer size.\n");
+        }
+
+        slots.resize(paths.size());
+        layerCount = 0;
+
+        for(size_t i : fullLayers){
+            textures[i].x = 0;
+            textures[i].y = 0;
+            slots[i].layer = layerCount++;
+            slots[i].uvRemap = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+        }
+
+        //shelf packing, tallest first so shelves waste little height
+        std::sort(atlased.begin(), atlased.end(), [&textures](size_t a, size_t b){ return textures[a].height > textures[b].height; });
+
+        uint32_t firstAtlasLayer = layerCount;
+        uint32_t shelfX = 0, shelfY = 0, shelfHeight = 0;
+        for(size_t n = 0; n < atlased.size(); ++n){
+            DecodedTexture& t = textures[atlased[n]];
+            uint32_t paddedWidth = t.width + 2 * ATLAS_PADDING;
+            uint32_t paddedHeight = t.height + 2 * ATLAS_PADDING;
+
+            if(n == 0) ++layerCount;
+            if(shelfX + paddedWidth > layerSize){
+                shelfY += shelfHeight;
+                shelfX = 0;
+                shelfHeight = 0;
+            }
+            if(shelfY + paddedHeight > layerSize){
+                ++layerCount;
+                shelfX = 0;
+                shelfY = 0;
+                shelfHeight = 0;
+            }
+
+            t.x = shelfX + ATLAS_PADDING;
+            t.y = shelfY + ATLAS_PADDING;
+            shelfX += paddedWidth;
+            shelfHeight = std::max(shelfHeight, paddedHeight);
+
+            slots[atlased[n]].layer = layerCount - 1;
+            slots[atlased[n]].uvRemap = glm::vec4(
+                t.width / static_cast<float>(layerSize), t.height / static_cast<float>(layerSize),
+                t.x / static_cast<float>(layerSize), t.y / static_cast<float>(layerSize));
+        }
+
+        mipLevels = static_cast<uint32_t>(std::floor(std::log2(layerSize))) + 1;
+
+        VkDeviceSize layerBytes = static_cast<VkDeviceSize>(layerSize) * layerSize * 4;
+        VkDeviceSize imageSize = layerBytes * layerCount;
+
+        ImageHelpers::CreateImage(layerSize, layerSize, mipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, arrayImage, arrayImageAllocation, deviceHandler, layerCount);
+
+        StagingRegion stagingRegion = commandBuffersHandler->GetStagingRing().reserve(imageSize);
+        unsigned char* staging = stagingRegion.mapped;
+
+        if(layerCount > firstAtlasLayer) memset(staging + firstAtlasLayer * layerBytes, 0, static_cast<size_t>((layerCount - firstAtlasLayer) * layerBytes));
+
+        for(size_t i = 0; i < textures.size(); ++i){
+            DecodedTexture& t = textures[i];
+            unsigned char* layer = staging + slots[i].layer * layerBytes;
+
+            if(t.width == layerSize && t.height == layerSize) memcpy(layer, t.pixels.get(), static_cast<size_t>(layerBytes));
+            else writePadded(t, layer);
+
+            t.pixels.reset();
+        }
+
+        //transition, copy and mip generation go out in one submit, right after the staging space they read was filled
+        VkCommandBuffer commandBuffer = commandBuffersHandler->beginSingleTimeCommands();
+        ImageHelpers::TransitionImageLayout(commandBuffer, arrayImage, IMAGE_ACCESS_TRANSFER_DST, deviceHandler);
+
+        //staging holds the layers back to back, so a single region covers all of them
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = stagingRegion.offset;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = layerCount;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {layerSize, layerSize, 1};
+
+        vkCmdCopyBufferToImage(commandBuffer, stagingRegion.buffer, arrayImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        ImageHelpers::GenerateMipmaps(commandBuffer, arrayImage, VK_FORMAT_R8G8B8A8_SRGB, layerSize, layerSize, mipLevels, deviceHandler, layerCount);
+
+        commandBuffersHandler->endSingleTimeCommands(commandBuffer);
+
+        if(DEBUG) std::cout << "Texture array: " << paths.size() << " textures in " << layerCount << " layers of " << layerSize << "x" << layerSize << '\n';
+    }
+
+    //copies an atlas entry to its place in the layer, repeating its edge texels out into the padding
+    void writePadded(DecodedTexture& t, unsigned char* layer){
+        int32_t padding = static_cast<int32_t>(ATLAS_PADDING);
+        int32_t width = static_cast<int32_t>(t.width);
+        int32_t height = static_cast<int32_t>(t.height);
+
+        for(int32_t y = -padding; y < height + padding; ++y){
+            int32_t srcY = std::clamp(y, 0, height - 1);
+            for(int32_t x = -padding; x < width + padding; ++x){
+                int32_t srcX = std::clamp(x, 0, width - 1);
+                size_t dst = (static_cast<size_t>(t.y + y) * layerSize + (t.x + x)) * 4;
+                memcpy(layer + dst, t.pixels.get() + (static_cast<size_t>(srcY) * width + srcX) * 4, 4);
+            }
+        }
+    }
+
+    void createSampler(){
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        //wrapping is done in the shader before the remap, the layer itself must not repeat into the neighbouring entry
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.anisotropyEnable = VK_TRUE;
+        samplerInfo.maxAnisotropy = deviceHandler->getCapabilities().getLimits().maxSamplerAnisotropy;
+        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = static_cast<float>(mipLevels);
+        samplerInfo.mipLodBias = 0.0f;
+
+        if(vkCreateSampler(deviceHandler->getLogicalDevice(), &samplerInfo, nullptr, &arraySampler) != VK_SUCCESS) throw std::runtime_error("Failed to create texture array sampler.\n");
+    }
+};
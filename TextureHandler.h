@@ -3,80 +3,375 @@
 #include <GLFW/glfw3.h>
 //vulkan.h is loaded above
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "3rdparty/stb_image.h"
 #include <stdexcept>
-
+#include <string>
+#include <vector>
+#include <array>
+#include <cmath>
+#include <algorithm>
+
+#include "StbImage.h"
+#include "PngDecoder.h"
+#include "ParallelHelpers.h"
 #include "ImageHelpers.h"
 #include "DeviceHandler.h"
 #include "CommandBuffersHandler.h"
 
 class TextureHandler{   
     VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
+    MemoryAllocation textureImageAllocation;
     VkImageView textureImageView;
     VkSampler textureSampler; //doesn't necesarrily need to be tied to a texture, but I dont need this to be separate in this program
-    uint32_t mipLevels;
+    uint32_t mipLevels; //levels currently resident on the gpu
+    uint32_t fullMipLevels; //levels of the complete chain
+    uint32_t droppedMips = 0; //top levels evicted by the residency manager, the resident image starts at this level of the full chain
+    uint32_t texWidth, texHeight; //full resolution, mip 0 of the complete chain
+    std::string path;
+
+    //a residency change in flight: the replacement image is filled by a submit nobody waits for, see beginDroppedMips and beginRestore
+    VkImage pendingImage = VK_NULL_HANDLE;
+    MemoryAllocation pendingImageAllocation;
+    uint32_t pendingDroppedMips = 0;
 
     DeviceHandler* deviceHandler;
 
 public:
-    TextureHandler(const char* path, DeviceHandler*& _dh, CommandBuffersHandler*& commandBuffersHandler) : deviceHandler(_dh){
-        createTextureImage(path, commandBuffersHandler);
+    //image, memory and view replaced by a residency change. Frames still in flight may sample it, so it is handed back to be destroyed later
+    struct RetiredImage{
+        VkImage image;
+        MemoryAllocation allocation;
+        VkImageView view;
+    };
+
+    //source pixels decoded into staging ring space, waiting to be copied into the image
+    struct StagedPixels{
+        StagingRegion region;
+        unsigned char* mapped;
+        VkDeviceSize size;
+        uint32_t width, height;
+    };
+
+    TextureHandler(const char* _path, DeviceHandler*& _dh, CommandBuffersHandler*& commandBuffersHandler) : path(_path), deviceHandler(_dh){
+        createTextureImage(textureImage, textureImageAllocation, commandBuffersHandler);
+        mipLevels = fullMipLevels;
+        createTextureImageView();
+        createTextureSampler();
+    }
+
+    //takes over pixels already decoded by DecodeStaged, see LoadTextures
+    TextureHandler(const char* _path, StagedPixels& staged, DeviceHandler*& _dh, CommandBuffersHandler*& commandBuffersHandler) : path(_path), deviceHandler(_dh){
+        uploadStaged(staged, textureImage, textureImageAllocation, commandBuffersHandler);
+        mipLevels = fullMipLevels;
         createTextureImageView();
         createTextureSampler();
     }
 
+    //loads several textures, decoding them in parallel on worker threads; vulkan calls stay on the calling thread
+    //all staging space is reserved up front, so an upload batch must be open: nothing is submitted before the batch, which reads all of it
+    static std::vector<TextureHandler*> LoadTextures(const std::vector<const char*>& paths, DeviceHandler*& deviceHandler, CommandBuffersHandler*& commandBuffersHandler){
+        if(!commandBuffersHandler->isUploadBatchOpen()) throw std::runtime_error("Textures can only be loaded together inside an upload batch.\n");
+
+        std::vector<StagedPixels> staged(paths.size());
+        for(size_t i = 0; i < paths.size(); ++i) staged[i] = BeginStaging(paths[i], commandBuffersHandler);
+
+        //on failure the reserved space is simply handed back with the next submit
+        ParallelHelpers::ParallelFor(paths.size(), [&](size_t i){ DecodeStaged(paths[i], staged[i]); });
+
+        std::vector<TextureHandler*> textures(paths.size());
+        for(size_t i = 0; i < paths.size(); ++i) textures[i] = new TextureHandler(paths[i], staged[i], deviceHandler, commandBuffersHandler);
+        return textures;
+    }
+
+    //reserves staging ring space large enough to decode the file at path into
+    static StagedPixels BeginStaging(const char* path, CommandBuffersHandler*& commandBuffersHandler){
+        int width, height, channels;
+        if(!stbi_info(path, &width, &height, &channels)) throw std::runtime_error("failed to load texture image!");
+
+        StagedPixels staged{};
+        staged.width = static_cast<uint32_t>(width);
+        staged.height = static_cast<uint32_t>(height);
+        staged.size = PngDecoder::GetDecodeSize(staged.width, staged.height);
+
+        staged.region = commandBuffersHandler->GetStagingRing().reserve(staged.size);
+        staged.mapped = staged.region.mapped;
+
+        return staged;
+    }
+
+    //fills the mapped staging buffer with RGBA8 pixels, touches no vulkan objects so it can run on any thread
+    static void DecodeStaged(const char* path, StagedPixels& staged){
+        if(PngDecoder::DecodeRGBA8(path, staged.width, staged.height, staged.mapped, static_cast<size_t>(staged.size))) return;
+
+        //formats the streaming decoder does not handle go through stb_image and one copy
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+        if(!pixels) throw std::runtime_error("failed to load texture image!");
+        if(static_cast<uint32_t>(width) != staged.width || static_cast<uint32_t>(height) != staged.height){
+            stbi_image_free(pixels);
+            throw std::runtime_error("Texture changed size while loading.\n");
+        }
+
+        memcpy(staged.mapped, pixels, static_cast<size_t>(width) * height * 4);
+        stbi_image_free(pixels);
+    }
+
+    //decodes the file at path and box filters the rest of its mip chain on the cpu, levels packed one after another, finest first
+    //restores upload it with copies alone, which the transfer queue can do; colors are averaged in linear space like the gpu's blits of sRGB images
+    static void DecodeMipChain(const char* path, uint32_t width, uint32_t height, std::vector<unsigned char>& chain){
+        DecodePixels(path, width, height, chain);
+
+        uint32_t levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+        size_t total = 0;
+        for(uint32_t level = 0; level < levels; ++level) total += static_cast<size_t>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+        chain.resize(total);
+
+        size_t srcOffset = 0;
+        for(uint32_t level = 1; level < levels; ++level){
+            uint32_t srcWidth = std::max(width >> (level - 1), 1u);
+            uint32_t srcHeight = std::max(height >> (level - 1), 1u);
+            uint32_t dstWidth = std::max(width >> level, 1u);
+            uint32_t dstHeight = std::max(height >> level, 1u);
+            size_t dstOffset = srcOffset + static_cast<size_t>(srcWidth) * srcHeight * 4;
+            const unsigned char* src = chain.data() + srcOffset;
+            unsigned char* dst = chain.data() + dstOffset;
+
+            for(uint32_t y = 0; y < dstHeight; ++y){
+                size_t row0 = static_cast<size_t>(std::min(2 * y, srcHeight - 1)) * srcWidth;
+                size_t row1 = static_cast<size_t>(std::min(2 * y + 1, srcHeight - 1)) * srcWidth;
+                for(uint32_t x = 0; x < dstWidth; ++x){
+                    size_t x0 = std::min(2 * x, srcWidth - 1);
+                    size_t x1 = std::min(2 * x + 1, srcWidth - 1);
+                    const unsigned char* taps[4] = {src + (row0 + x0) * 4, src + (row0 + x1) * 4, src + (row1 + x0) * 4, src + (row1 + x1) * 4};
+                    unsigned char* out = dst + (static_cast<size_t>(y) * dstWidth + x) * 4;
+
+                    for(int c = 0; c < 3; ++c){
+                        float sum = 0.0f;
+                        for(auto* tap : taps) sum += SrgbToLinear(tap[c]);
+                        out[c] = LinearToSrgb(sum * 0.25f);
+                    }
+                    out[3] = static_cast<unsigned char>((taps[0][3] + taps[1][3] + taps[2][3] + taps[3][3] + 2) / 4);
+                }
+            }
+            srcOffset = dstOffset;
+        }
+    }
+
+    //decodes the file at path into host memory, for reloads off the main thread where no staging space can be held on to
+    static void DecodePixels(const char* path, uint32_t width, uint32_t height, std::vector<unsigned char>& pixels){
+        StagedPixels staged{};
+        staged.width = width;
+        staged.height = height;
+        staged.size = PngDecoder::GetDecodeSize(width, height);
+        pixels.resize(static_cast<size_t>(staged.size));
+        staged.mapped = pixels.data();
+
+        DecodeStaged(path, staged);
+    }
+
+    //a change still in flight at destruction only happens while the device is idle
     ~TextureHandler(){
+        if(pendingImage != VK_NULL_HANDLE) ImageHelpers::DestroyImage(pendingImage, pendingImageAllocation, deviceHandler);
         vkDestroySampler(deviceHandler->getLogicalDevice(), textureSampler, nullptr);
         vkDestroyImageView(deviceHandler->getLogicalDevice(), textureImageView, nullptr);
-        vkDestroyImage(deviceHandler->getLogicalDevice(), textureImage, nullptr);
-        vkFreeMemory(deviceHandler->getLogicalDevice(), textureImageMemory, nullptr);
+        ImageHelpers::DestroyImage(textureImage, textureImageAllocation, deviceHandler);
     }
 
     inline VkImageView getTextureImageView(){ return textureImageView; }
+    inline const MemoryAllocation& getAllocation(){ return textureImageAllocation; }
     inline VkSampler getTextureSampler() { return textureSampler; }
+    inline uint32_t getMipLevels() { return mipLevels; }
+    inline uint32_t getFullMipLevels() { return fullMipLevels; }
+    inline uint32_t getDroppedMips() { return droppedMips; }
+    inline uint32_t getWidth() { return texWidth; }
+    inline uint32_t getHeight() { return texHeight; }
+    inline const std::string& getPath() { return path; }
+    inline bool isResidencyChangePending() { return pendingImage != VK_NULL_HANDLE; }
+
+    //bytes of one level of the full chain (RGBA8)
+    VkDeviceSize getMipSize(uint32_t level){
+        VkDeviceSize width = std::max(texWidth >> level, 1u);
+        VkDeviceSize height = std::max(texHeight >> level, 1u);
+        return width * height * 4;
+    }
 
-private:
-    void createTextureImage(const char* path, CommandBuffersHandler*& commandBuffersHandler){ //device handler needed for BufferHelpers
-        int texWidth, texHeight, texChannels;
-        stbi_uc* pixels = stbi_load(path, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-        VkDeviceSize imageSize = texWidth * texHeight * 4;
+    //bytes resident with the given number of top levels dropped
+    VkDeviceSize getResidentSize(uint32_t dropped){
+        VkDeviceSize size = 0;
+        for(uint32_t level = dropped; level < fullMipLevels; ++level) size += getMipSize(level);
+        return size;
+    }
+    inline VkDeviceSize getResidentSize(){ return getResidentSize(droppedMips); }
 
-        if (!pixels)
-            throw std::runtime_error("failed to load texture image!");
+    //records and submits building an image holding only levels [dropped, fullMipLevels) of the chain, copied out of the resident levels without waiting
+    //returns the upload's serial, the texture keeps its current image until commitDroppedMips is called after CommandBuffersHandler::isUploadFinished(serial)
+    uint64_t beginDroppedMips(uint32_t dropped, CommandBuffersHandler*& commandBuffersHandler){
+        if(isResidencyChangePending()) throw std::runtime_error("A residency change of this texture is already in flight.\n");
+        dropped = std::min(dropped, fullMipLevels - 1); //always keep at least the smallest level
+        if(dropped <= droppedMips) throw std::runtime_error("Restoring mip levels goes through beginRestore.\n");
 
-        mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+        uint32_t newMipLevels = fullMipLevels - dropped;
+        uint32_t width = std::max(texWidth >> dropped, 1u);
+        uint32_t height = std::max(texHeight >> dropped, 1u);
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        BufferHelpers::CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory, deviceHandler);
+        //the source is owned by graphics and sampled by frames in flight, so the copy stays on the graphics queue behind them
+        VkCommandBuffer commandBuffer = commandBuffersHandler->beginSingleTimeCommands();
+        ImageHelpers::CreateImage(width, height, newMipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pendingImage, pendingImageAllocation, deviceHandler);
+        recordMipChainCopy(commandBuffer, textureImage, dropped - droppedMips, pendingImage, newMipLevels, width, height);
 
-        void* data;
-        vkMapMemory(deviceHandler->getLogicalDevice(), stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
-        vkUnmapMemory(deviceHandler->getLogicalDevice(), stagingBufferMemory);
+        pendingDroppedMips = dropped;
+        return commandBuffersHandler->endSingleTimeCommandsAsync(commandBuffer);
+    }
 
-        stbi_image_free(pixels);
+    //starts bringing back levels [dropped, fullMipLevels) from a chain built by DecodeMipChain, copied into a new image on the transfer queue without waiting
+    //returns the transfer's ticket, the texture keeps its current image until commitDroppedMips is called after CommandBuffersHandler::isTransferAcquired(ticket)
+    uint64_t beginRestore(uint32_t dropped, const std::vector<unsigned char>& chain, CommandBuffersHandler*& commandBuffersHandler){
+        if(isResidencyChangePending()) throw std::runtime_error("A residency change of this texture is already in flight.\n");
+        if(dropped >= droppedMips) throw std::runtime_error("Dropping mip levels goes through beginDroppedMips.\n");
+        if(chain.size() != getResidentSize(0)) throw std::runtime_error("Decoded mip chain does not match the texture.\n");
+
+        uint32_t newMipLevels = fullMipLevels - dropped;
+        uint32_t width = std::max(texWidth >> dropped, 1u);
+        uint32_t height = std::max(texHeight >> dropped, 1u);
+
+        //nothing else reads the new image yet, so the transfer queue can fill it while graphics keeps rendering
+        ImageHelpers::CreateImage(width, height, newMipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pendingImage, pendingImageAllocation, deviceHandler);
+
+        //staged right before the submit, nothing else can be submitted in between and claim the space
+        VkDeviceSize size = getResidentSize(dropped);
+        StagingRegion region = commandBuffersHandler->GetStagingRing().reserve(size, 4);
+        memcpy(region.mapped, chain.data() + static_cast<size_t>(getResidentSize(0) - size), static_cast<size_t>(size));
+
+        pendingDroppedMips = dropped;
+        return ImageHelpers::CopyBufferToImageAsync(region.buffer, region.offset, pendingImage, width, height, deviceHandler, commandBuffersHandler, newMipLevels);
+    }
+
+    //switches to the image built by beginDroppedMips or beginRestore, whose upload must have landed; the frame being recorded is the first to use it
+    //the old image is handed back, frames in flight may still sample it
+    RetiredImage commitDroppedMips(){
+        if(!isResidencyChangePending()) throw std::runtime_error("No residency change of this texture is in flight.\n");
+        RetiredImage retired{textureImage, textureImageAllocation, textureImageView};
+
+        textureImage = pendingImage;
+        textureImageAllocation = pendingImageAllocation;
+        pendingImage = VK_NULL_HANDLE;
+        droppedMips = pendingDroppedMips;
+        mipLevels = fullMipLevels - droppedMips;
+        createTextureImageView();
 
-        ImageHelpers::CreateImage(texWidth, texHeight, mipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory, deviceHandler);
+        return retired;
+    }
+
+    //records copying the resident image into memory outside its current block for the defragmenter and switches to the copy
+    //the frames submitted after commandBuffer use it; busy while a residency change is in flight, it is moved once the change has landed
+    MoveResult relocate(VkCommandBuffer commandBuffer, RetiredImage& retired){
+        if(isResidencyChangePending()) return MOVE_BUSY;
+
+        uint32_t width = std::max(texWidth >> droppedMips, 1u);
+        uint32_t height = std::max(texHeight >> droppedMips, 1u);
+
+        VkImage newImage;
+        ImageHelpers::CreateUnboundImage(width, height, mipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, newImage, deviceHandler);
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(deviceHandler->getLogicalDevice(), newImage, &memRequirements);
+
+        MemoryAllocation newImageAllocation;
+        if(!deviceHandler->getAllocator().allocateMoved(textureImageAllocation, memRequirements, newImageAllocation)){
+            ImageHelpers::DestroyUnboundImage(newImage, deviceHandler);
+            return MOVE_NO_ROOM;
+        }
+        vkBindImageMemory(deviceHandler->getLogicalDevice(), newImage, newImageAllocation.memory, newImageAllocation.offset);
+
+        recordMipChainCopy(commandBuffer, textureImage, 0, newImage, mipLevels, width, height);
+
+        retired = RetiredImage{textureImage, textureImageAllocation, textureImageView};
+        textureImage = newImage;
+        textureImageAllocation = newImageAllocation;
+        createTextureImageView();
+        return MOVE_DONE;
+    }
 
-        ImageHelpers::TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, commandBuffersHandler);
-        copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), commandBuffersHandler);
-        //happens when generating mipmaps
-        //ImageHelpers::TransitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels, commandBuffersHandler);
+private:
+    static float SrgbToLinear(unsigned char value){
+        static const std::array<float, 256> table = [](){
+            std::array<float, 256> t;
+            for(int i = 0; i < 256; ++i){
+                float c = i / 255.0f;
+                t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return t;
+        }();
+        return table[value];
+    }
 
-        vkDestroyBuffer(deviceHandler->getLogicalDevice(), stagingBuffer, nullptr);
-        vkFreeMemory(deviceHandler->getLogicalDevice(), stagingBufferMemory, nullptr);
+    static unsigned char LinearToSrgb(float value){
+        float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+        return static_cast<unsigned char>(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
 
-        generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels, commandBuffersHandler);
+    void createTextureImage(VkImage& image, MemoryAllocation& imageAllocation, CommandBuffersHandler*& commandBuffersHandler){ //device handler needed for BufferHelpers
+        StagedPixels staged = BeginStaging(path.c_str(), commandBuffersHandler);
+        DecodeStaged(path.c_str(), staged);
+        uploadStaged(staged, image, imageAllocation, commandBuffersHandler);
     }
 
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, CommandBuffersHandler*& commandBuffersHandler) {
+    //copies decoded pixels into a new full chain image, the staging space is reclaimed once the copy has finished
+    void uploadStaged(StagedPixels& staged, VkImage& image, MemoryAllocation& imageAllocation, CommandBuffersHandler*& commandBuffersHandler){
+        texWidth = staged.width;
+        texHeight = staged.height;
+        fullMipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+
         VkCommandBuffer commandBuffer = commandBuffersHandler->beginSingleTimeCommands();
+        recordFullChainUpload(commandBuffer, staged.region.buffer, staged.region.offset, image, imageAllocation);
+        commandBuffersHandler->endSingleTimeCommands(commandBuffer);
+    }
+
+    //creates a full chain image and records filling it from level 0 pixels at offset in buffer: transition, copy and mip generation
+    void recordFullChainUpload(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkImage& image, MemoryAllocation& imageAllocation){
+        ImageHelpers::CreateImage(texWidth, texHeight, fullMipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageAllocation, deviceHandler);
+
+        ImageHelpers::TransitionImageLayout(commandBuffer, image, IMAGE_ACCESS_TRANSFER_DST, deviceHandler);
+        copyBufferToImage(commandBuffer, buffer, offset, image, texWidth, texHeight);
+        ImageHelpers::GenerateMipmaps(commandBuffer, image, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, fullMipLevels, deviceHandler); //ends in SHADER_READ_ONLY_OPTIMAL
+    }
 
+
+    //src is left in SHADER_READ_ONLY_OPTIMAL since in-flight frames may still be sampling it, dst ends up there too
+    void recordMipChainCopy(VkCommandBuffer commandBuffer, VkImage src, uint32_t srcBaseLevel, VkImage dst, uint32_t levelCount, uint32_t width, uint32_t height){
+        BarrierBatcher barriers(deviceHandler);
+        barriers.transition(src, IMAGE_ACCESS_TRANSFER_SRC, srcBaseLevel, levelCount);
+        barriers.transition(dst, IMAGE_ACCESS_TRANSFER_DST, 0, levelCount);
+        barriers.flush(commandBuffer);
+
+        std::vector<VkImageCopy> regions(levelCount);
+        for(uint32_t i = 0; i < levelCount; ++i){
+            regions[i].srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[i].srcSubresource.mipLevel = srcBaseLevel + i;
+            regions[i].srcSubresource.baseArrayLayer = 0;
+            regions[i].srcSubresource.layerCount = 1;
+            regions[i].srcOffset = {0, 0, 0};
+            regions[i].dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            regions[i].dstSubresource.mipLevel = i;
+            regions[i].dstSubresource.baseArrayLayer = 0;
+            regions[i].dstSubresource.layerCount = 1;
+            regions[i].dstOffset = {0, 0, 0};
+            regions[i].extent = {std::max(width >> i, 1u), std::max(height >> i, 1u), 1};
+        }
+
+        vkCmdCopyImage(commandBuffer,
+            src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()), regions.data());
+
+        barriers.transition(src, IMAGE_ACCESS_SHADER_READ, srcBaseLevel, levelCount);
+        barriers.transition(dst, IMAGE_ACCESS_SHADER_READ, 0, levelCount);
+        barriers.flush(commandBuffer);
+    }
+
+    //records filling level 0 of image, which must be in TRANSFER_DST_OPTIMAL
+    void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height) {
         VkBufferImageCopy region{};
-        region.bufferOffset = 0;
+        region.bufferOffset = bufferOffset;
         region.bufferRowLength = 0;
         region.bufferImageHeight = 0;
         region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -91,105 +386,13 @@ private:
         };
 
         vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-        commandBuffersHandler->endSingleTimeCommands(commandBuffer);
-    }
-
-    void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels, CommandBuffersHandler*& commandBuffersHandler) {
-        //check if image format supports linear blitting
-        VkFormatProperties formatProperties;
-        vkGetPhysicalDeviceFormatProperties(deviceHandler->getPhysicalDevice(), imageFormat, &formatProperties);
-
-        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
-            throw std::runtime_error("texture image format does not support linear blitting!");
-
-        VkCommandBuffer commandBuffer = commandBuffersHandler->beginSingleTimeCommands();
-
-        VkImageMemoryBarrier barrier{};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.image = image;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-        barrier.subresourceRange.levelCount = 1;
-
-        int32_t mipWidth = texWidth;
-        int32_t mipHeight = texHeight;
-
-        for (uint32_t i = 1; i < mipLevels; i++) {
-            barrier.subresourceRange.baseMipLevel = i - 1;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-            vkCmdPipelineBarrier(commandBuffer,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier);
-
-            VkImageBlit blit{};
-            blit.srcOffsets[0] = {0, 0, 0};
-            blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
-            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.srcSubresource.mipLevel = i - 1;
-            blit.srcSubresource.baseArrayLayer = 0;
-            blit.srcSubresource.layerCount = 1;
-            blit.dstOffsets[0] = {0, 0, 0};
-            blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            blit.dstSubresource.mipLevel = i;
-            blit.dstSubresource.baseArrayLayer = 0;
-            blit.dstSubresource.layerCount = 1;
-
-            vkCmdBlitImage(commandBuffer,
-                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                1, &blit,
-                VK_FILTER_LINEAR);
-
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-            vkCmdPipelineBarrier(commandBuffer,
-                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-                0, nullptr,
-                0, nullptr,
-                1, &barrier);
-
-            if (mipWidth > 1) mipWidth /= 2;
-            if (mipHeight > 1) mipHeight /= 2;
-        }
-
-        barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        vkCmdPipelineBarrier(commandBuffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-            0, nullptr,
-            0, nullptr,
-            1, &barrier);
-
-        commandBuffersHandler->endSingleTimeCommands(commandBuffer);
     }
-    
 
     void createTextureImageView(){
         textureImageView = ImageHelpers::CreateImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels, deviceHandler->getLogicalDevice());
     }
 
     void createTextureSampler() {
-        VkPhysicalDeviceProperties properties{};
-        vkGetPhysicalDeviceProperties(deviceHandler->getPhysicalDevice(), &properties);
-
         VkSamplerCreateInfo samplerInfo{};
         samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
         samplerInfo.magFilter = VK_FILTER_LINEAR;
@@ -198,7 +401,7 @@ private:
         samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
         samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
         samplerInfo.anisotropyEnable = VK_TRUE;
-        samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+        samplerInfo.maxAnisotropy = deviceHandler->getCapabilities().getLimits().maxSamplerAnisotropy;
         samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
         samplerInfo.unnormalizedCoordinates = VK_FALSE;
         samplerInfo.compareEnable = VK_FALSE;
@@ -0,0 +1,368 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include <array>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Globals.h"
+#include "DeviceHandler.h"
+#include "CommandBuffersHandler.h"
+#include "TextureHandler.h"
+#include "DescriptorSetsHandler.h"
+#include "AllocationTracker.h"
+
+//where a texture's residency change is, changes take several frames and none of them waits on the gpu or the disk
+enum ResidencyStage : uint32_t{
+    RESIDENCY_IDLE,
+    RESIDENCY_DECODING, //restores only, the source file is being decoded and its mips built on the decoder thread
+    RESIDENCY_UPLOADING //the replacement image is being filled by a submit nobody waits for, on the transfer queue for restores
+};
+
+//keeps the textures it is given under a memory budget by dropping and restoring their top mip levels
+//demand is estimated from how large the object a texture is drawn on appears on screen
+class TextureResidencyManager{
+    struct ResidentTexture{
+        TextureHandler* texture;
+        glm::vec3 center; //world space bounding sphere of what the texture is drawn on
+        float radius;
+        uint32_t descriptorIndex; //element of the bindless texture array, 0 otherwise
+        uint32_t wantedDroppedMips = 0; //top levels that can go without visible loss, from the last demand estimate
+        uint64_t lastDemandFrame = 0; //last frame the texture was inside the view frustum, for LRU eviction
+        std::array<bool, FRAMES_IN_FLIGHT_LIMIT> descriptorDirty{}; //frame slots whose set still points at the previous image, sets created later start out current
+
+        ResidencyStage stage = RESIDENCY_IDLE;
+        uint32_t targetDroppedMips = 0; //what the change in flight moves to
+        uint64_t uploadSerial = 0; //of the graphics submit filling the replacement image, evictions
+        uint64_t transferTicket = 0; //of the transfer filling it, restores; 0 otherwise
+        bool reloadFailed = false; //the source file could not be decoded, never restored again
+    };
+
+    //a restore's source file, decoded off the main thread
+    struct DecodeJob{
+        TextureHandler* texture;
+        std::string path;
+        uint32_t width, height;
+        std::vector<unsigned char> chain; //every level RGBA8, see TextureHandler::DecodeMipChain; empty if decoding failed
+    };
+
+    std::vector<ResidentTexture> textures;
+
+    VkDeviceSize budget;
+    uint32_t maxChangesPerFrame = 1; //every change is an image recreation + copy, so spread them out over frames
+    uint64_t frameNumber = 0;
+    uint64_t changeCount = 0; //bumped whenever a change starts, advances or lands
+
+    std::thread decoderThread;
+    std::mutex decoderMutex;
+    std::condition_variable decoderCondition;
+    std::deque<DecodeJob> decodeRequests;
+    std::vector<DecodeJob> decodedJobs; //handed back to the main thread
+    std::vector<DecodeJob> readyJobs; //scratch the main thread swaps decodedJobs into
+    bool stopDecoder = false;
+
+    DeviceHandler* deviceHandler;
+    CommandBuffersHandler* commandBuffersHandler;
+    DescriptorSetsHandler* descriptorSets;
+
+public:
+    TextureResidencyManager(DeviceHandler* _dh, CommandBuffersHandler* _cbh, DescriptorSetsHandler* _ds, VkDeviceSize _budget)
+    : budget(_budget), deviceHandler(_dh), commandBuffersHandler(_cbh), descriptorSets(_ds){
+        decoderThread = std::thread(&TextureResidencyManager::decoderLoop, this);
+    }
+
+    ~TextureResidencyManager(){
+        {
+            std::lock_guard<std::mutex> lock(decoderMutex);
+            stopDecoder = true;
+        }
+        decoderCondition.notify_one();
+        decoderThread.join();
+    }
+
+    inline void setBudget(VkDeviceSize _budget){ budget = _budget; }
+    inline VkDeviceSize getBudget(){ return budget; }
+    inline void setMaxChangesPerFrame(uint32_t changes){ maxChangesPerFrame = changes; }
+    inline uint64_t getChangeCount(){ return changeCount; }
+
+    void registerTexture(TextureHandler* texture, glm::vec3 center, float radius, uint32_t descriptorIndex = 0){
+        ResidentTexture t{};
+        t.texture = texture;
+        t.center = center;
+        t.radius = radius;
+        t.descriptorIndex = descriptorIndex;
+        textures.push_back(t);
+    }
+
+    //a change still in flight is dropped with it, the texture frees its replacement image when destroyed
+    void unregisterTexture(TextureHandler* texture){
+        textures.erase(std::remove_if(textures.begin(), textures.end(), [texture](ResidentTexture& t){ return t.texture == texture; }), textures.end());
+    }
+
+    //records moving a registered texture's image for the defragmenter, retiring the old one and repointing descriptors like a residency change
+    //busy while a change is in flight, the defragmenter asks again once it has landed
+    MoveResult relocate(TextureHandler* texture, VkCommandBuffer commandBuffer){
+        for(auto& t : textures){
+            if(t.texture != texture) continue;
+            if(t.stage != RESIDENCY_IDLE) return MOVE_BUSY;
+
+            TextureHandler::RetiredImage old{};
+            MoveResult result = texture->relocate(commandBuffer, old);
+            if(result != MOVE_DONE) return result;
+            retire(old);
+
+            t.descriptorDirty.fill(true);
+            return MOVE_DONE;
+        }
+        return MOVE_NO_ROOM; //not registered, nothing could repoint its descriptors
+    }
+
+    VkDeviceSize getResidentBytes(){
+        VkDeviceSize total = 0;
+        for(auto& t : textures) total += t.texture->getResidentSize();
+        return total;
+    }
+
+    //call once per frame after the frame last using currentFrame's slot has finished, so that frame's descriptor set can be rewritten
+    void update(uint32_t currentFrame, const glm::mat4& view, const glm::mat4& projection, float viewportHeight){
+        ++frameNumber;
+
+        advanceChanges();
+        estimateDemand(view, projection, viewportHeight);
+
+        uint32_t changes = 0;
+        VkDeviceSize used = getPlannedBytes();
+
+        //over budget: evict a top level, least recently demanded textures first
+        while(used > budget && changes < maxChangesPerFrame){
+            ResidentTexture* victim = findEvictionCandidate();
+            if(victim == nullptr) break;
+
+            VkDeviceSize before = victim->texture->getResidentSize();
+            uint32_t target = victim->texture->getDroppedMips() + 1;
+            changeResidency(*victim, target);
+            used -= before - victim->texture->getResidentSize(target);
+            ++changes;
+        }
+
+        //under budget: bring detail back to the most recently demanded textures that want it
+        while(changes < maxChangesPerFrame){
+            uint32_t target;
+            ResidentTexture* candidate = findRestoreCandidate(budget > used ? budget - used : 0, target);
+            if(candidate == nullptr) break;
+
+            VkDeviceSize before = candidate->texture->getResidentSize();
+            changeResidency(*candidate, target);
+            used += candidate->texture->getResidentSize(target) - before;
+            ++changes;
+        }
+
+        for(auto& t : textures){
+            if(t.descriptorDirty[currentFrame]){
+                descriptorSets->updateTextureDescriptor(currentFrame, t.texture, t.descriptorIndex);
+                t.descriptorDirty[currentFrame] = false;
+            }
+        }
+    }
+
+private:
+    //bytes resident once every change in flight has landed
+    VkDeviceSize getPlannedBytes(){
+        VkDeviceSize total = 0;
+        for(auto& t : textures) total += t.texture->getResidentSize(t.stage == RESIDENCY_IDLE ? t.texture->getDroppedMips() : t.targetDroppedMips);
+        return total;
+    }
+
+    //restores whose file is decoded get their upload submitted, finished uploads swap images and mark descriptors dirty
+    void advanceChanges(){
+        {
+            std::lock_guard<std::mutex> lock(decoderMutex);
+            readyJobs.swap(decodedJobs);
+        }
+
+        for(auto& job : readyJobs){
+            auto it = std::find_if(textures.begin(), textures.end(), [&job](ResidentTexture& t){ return t.texture == job.texture; });
+            if(it == textures.end() || it->stage != RESIDENCY_DECODING) continue; //unregistered meanwhile
+            ++changeCount;
+
+            if(job.chain.empty()){
+                it->stage = RESIDENCY_IDLE;
+                it->reloadFailed = true;
+                continue;
+            }
+
+            it->transferTicket = it->texture->beginRestore(it->targetDroppedMips, job.chain, commandBuffersHandler);
+            it->stage = RESIDENCY_UPLOADING;
+        }
+        readyJobs.clear();
+
+        for(auto& t : textures){
+            if(t.stage != RESIDENCY_UPLOADING) continue;
+            //a restore's image is usable once a frame has acquired it from the transfer queue, that frame was submitted before the one recorded next
+            bool landed = t.transferTicket != 0 ? commandBuffersHandler->isTransferAcquired(t.transferTicket) : commandBuffersHandler->isUploadFinished(t.uploadSerial);
+            if(!landed) continue;
+
+            retire(t.texture->commitDroppedMips());
+            t.descriptorDirty.fill(true);
+            t.stage = RESIDENCY_IDLE;
+            t.transferTicket = 0;
+            ++changeCount;
+        }
+    }
+
+    //textures outside the view frustum want only their smallest level and are not counted as demanded
+    void estimateDemand(const glm::mat4& view, const glm::mat4& projection, float viewportHeight){
+        std::array<glm::vec4, 6> planes = getFrustumPlanes(projection * view);
+
+        for(auto& t : textures){
+            uint32_t maxDropped = t.texture->getFullMipLevels() - 1;
+
+            if(!isSphereVisible(planes, t.center, t.radius)){
+                t.wantedDroppedMips = maxDropped;
+                continue;
+            }
+
+            glm::vec4 viewPos = view * glm::vec4(t.center, 1.0f);
+            float distance = -viewPos.z; //camera looks down -z in view space
+
+            //projected diameter of the bounding sphere in pixels, treating the camera as inside it when closer than the radius
+            float pixels = 2.0f * t.radius * std::abs(projection[1][1]) * 0.5f * viewportHeight / std::max(distance, t.radius);
+            float texels = static_cast<float>(std::max(t.texture->getWidth(), t.texture->getHeight()));
+            float ratio = texels / std::max(pixels, 1.0f);
+
+            uint32_t wanted = ratio > 1.0f ? static_cast<uint32_t>(std::floor(std::log2(ratio))) : 0;
+            t.wantedDroppedMips = std::min(wanted, maxDropped);
+            t.lastDemandFrame = frameNumber;
+        }
+    }
+
+    //left, right, bottom, top, near, far of a clip space with depth in [0, 1] (GLM_FORCE_DEPTH_ZERO_TO_ONE), inside where dot(plane, point) >= 0
+    static std::array<glm::vec4, 6> getFrustumPlanes(const glm::mat4& viewProjection){
+        glm::vec4 rows[4];
+        for(int i = 0; i < 4; ++i) rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        return {rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2]};
+    }
+
+    static bool isSphereVisible(const std::array<glm::vec4, 6>& planes, glm::vec3 center, float radius){
+        for(auto& plane : planes){
+            glm::vec3 normal(plane);
+            if(glm::dot(normal, center) + plane.w < -radius * glm::length(normal)) return false;
+        }
+        return true;
+    }
+
+    ResidentTexture* findEvictionCandidate(){
+        ResidentTexture* victim = nullptr;
+
+        for(auto& t : textures){
+            if(t.stage != RESIDENCY_IDLE) continue;
+            uint32_t dropped = t.texture->getDroppedMips();
+            if(dropped + 1 >= t.texture->getFullMipLevels()) continue;
+
+            if(victim == nullptr){
+                victim = &t;
+                continue;
+            }
+
+            //textures holding more detail than they are asked for go first, then the least recently demanded
+            bool tSurplus = dropped < t.wantedDroppedMips;
+            bool victimSurplus = victim->texture->getDroppedMips() < victim->wantedDroppedMips;
+            if(tSurplus != victimSurplus){
+                if(tSurplus) victim = &t;
+            }
+            else if(t.lastDemandFrame < victim->lastDemandFrame) victim = &t;
+        }
+
+        return victim;
+    }
+
+    ResidentTexture* findRestoreCandidate(VkDeviceSize headroom, uint32_t& target){
+        ResidentTexture* candidate = nullptr;
+
+        for(auto& t : textures){
+            if(t.stage != RESIDENCY_IDLE || t.reloadFailed) continue;
+            uint32_t dropped = t.texture->getDroppedMips();
+            if(dropped <= t.wantedDroppedMips) continue;
+            if(candidate != nullptr && t.lastDemandFrame <= candidate->lastDemandFrame) continue;
+
+            //go as far towards the wanted level as the budget allows
+            uint32_t fits = t.wantedDroppedMips;
+            while(fits < dropped && t.texture->getResidentSize(fits) - t.texture->getResidentSize(dropped) > headroom) ++fits;
+            if(fits == dropped) continue;
+
+            candidate = &t;
+            target = fits;
+        }
+
+        return candidate;
+    }
+
+    //evictions copy levels already resident on the graphics queue right away, restores wait for the decoder thread and then go out on the transfer queue
+    //frames keep sampling the current image until the change lands in advanceChanges
+    void changeResidency(ResidentTexture& t, uint32_t dropped){
+        if(DEBUG) std::cout << "Texture residency: " << t.texture->getDroppedMips() << " -> " << dropped << " dropped mips\n";
+
+        t.targetDroppedMips = dropped;
+        ++changeCount;
+
+        if(dropped > t.texture->getDroppedMips()){
+            t.uploadSerial = t.texture->beginDroppedMips(dropped, commandBuffersHandler);
+            t.stage = RESIDENCY_UPLOADING;
+            return;
+        }
+
+        t.stage = RESIDENCY_DECODING;
+        {
+            std::lock_guard<std::mutex> lock(decoderMutex);
+            decodeRequests.push_back({t.texture, t.texture->getPath(), t.texture->getWidth(), t.texture->getHeight(), {}});
+        }
+        decoderCondition.notify_one();
+    }
+
+    void decoderLoop(){
+        AllocationTracker::ignoreThisThread(); //decodes on its own schedule, pixel buffers are allocated here
+
+        while(true){
+            DecodeJob job;
+            {
+                std::unique_lock<std::mutex> lock(decoderMutex);
+                decoderCondition.wait(lock, [this]{ return stopDecoder || !decodeRequests.empty(); });
+                if(stopDecoder) return;
+
+                job = std::move(decodeRequests.front());
+                decodeRequests.pop_front();
+            }
+
+            try{
+                TextureHandler::DecodeMipChain(job.path.c_str(), job.width, job.height, job.chain);
+            }
+            catch(std::exception& e){
+                if(DEBUG) std::cout << "Texture reload failed: " << e.what();
+                job.chain.clear();
+            }
+
+            std::lock_guard<std::mutex> lock(decoderMutex);
+            decodedJobs.push_back(std::move(job));
+        }
+    }
+
+    //the frame being recorded is the last one to bind the old image, every set is rewritten before its next use
+    void retire(TextureHandler::RetiredImage image){
+        DeviceHandler* dh = deviceHandler;
+        deviceHandler->getDeletionQueue().retire([dh, image]() mutable {
+            vkDestroyImageView(dh->getLogicalDevice(), image.view, nullptr);
+            ImageHelpers::DestroyImage(image.image, image.allocation, dh);
+        });
+    }
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+
+//where a mesh's texture lives: which layer of a texture array and the part of the layer it was packed into, or its index in the bindless table
+//pushed as a constant per draw, so every mesh can share one descriptor set
+struct TextureSlot{
+	glm::vec4 uvRemap = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f); //xy scale, zw offset applied to the wrapped texture coordinate
+	uint32_t layer = 0;
+	uint32_t textureIndex = 0; //element of the bindless texture array
+};
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+
+#include "Globals.h"
+#include "MemoryAllocator.h"
+
+//groups of attachments that are in use at different times, e.g. depth buffers of passes that clear on load and never store
+enum AliasGroup : uint32_t{
+    ALIAS_GROUP_NONE, //memory of its own
+    ALIAS_GROUP_RENDER_GRAPH //first of the groups RenderGraph assigns, it uses this and every value after it
+};
+
+//creates attachments that live only within a render pass: transient usage, lazily allocated memory where the device has it
+//attachments of one alias group share memory, the passes using them must be ordered by barriers or subpass dependencies
+//that cover the previous user's writes, and every user has to start from an UNDEFINED layout
+class TransientAttachmentPool{
+    //a piece of memory images of a group are bound to, freed once none are left
+    struct AliasedMemory{
+        MemoryAllocation allocation;
+        uint32_t users = 0;
+    };
+
+    std::unordered_map<uint32_t, AliasedMemory*> current; //per group, what new images bind to if they fit
+    std::unordered_map<VkImage, AliasedMemory*> bound;
+
+    VkDevice logicalDevice;
+    MemoryAllocator* allocator;
+
+public:
+    TransientAttachmentPool(VkDevice _ld, MemoryAllocator* _allocator) : logicalDevice(_ld), allocator(_allocator){}
+
+    ~TransientAttachmentPool(){
+        std::vector<AliasedMemory*> memories;
+        for(auto& b : bound) memories.push_back(b.second);
+        for(auto& c : current) memories.push_back(c.second);
+
+        std::sort(memories.begin(), memories.end());
+        memories.erase(std::unique(memories.begin(), memories.end()), memories.end());
+        for(AliasedMemory* memory : memories){
+            if(memory != nullptr) free(memory);
+        }
+    }
+
+    VkImage createImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, AliasGroup group){
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {width, height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT; //only attachment usages may be combined with it
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkImage image;
+        if(vkCreateImage(logicalDevice, &imageInfo, nullptr, &image) != VK_SUCCESS) throw std::runtime_error("Failed to create transient attachment.\n");
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(logicalDevice, image, &memRequirements);
+
+        //lazily allocated memory may never be backed at all on tiled gpus, where the attachment stays in tile memory
+        VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        if(allocator->hasMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+
+        MemoryCategory category = usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT ? MEMORY_CATEGORY_DEPTH : MEMORY_CATEGORY_OTHER;
+        AliasedMemory* memory = group == ALIAS_GROUP_NONE ? nullptr : current[group];
+
+        bool fits = memory != nullptr
+            && memory->allocation.size >= memRequirements.size
+            && memory->allocation.offset % memRequirements.alignment == 0
+            && (memRequirements.memoryTypeBits & (1u << memory->allocation.memoryType));
+
+        if(!fits){
+            memory = new AliasedMemory{};
+            memory->allocation = allocator->allocateForAliasing(memRequirements, properties, category);
+            if(group != ALIAS_GROUP_NONE){
+                if(current[group] != nullptr && current[group]->users == 0) free(current[group]);
+                current[group] = memory;
+            }
+        }
+        else if(DEBUG) std::cout << "Transient attachment: " << width << "x" << height << " aliased with an attachment of group " << group << '\n';
+
+        vkBindImageMemory(logicalDevice, image, memory->allocation.memory, memory->allocation.offset);
+        ++memory->users;
+        bound[image] = memory;
+
+        return image;
+    }
+
+    void destroyImage(VkImage image){
+        auto it = bound.find(image);
+        if(it == bound.end()) throw std::runtime_error("Destroying an image that is not a transient attachment.\n");
+
+        vkDestroyImage(logicalDevice, image, nullptr);
+        release(it->second);
+        bound.erase(it);
+    }
+
+private:
+    //a group's current memory stays around without users, so an attachment recreated on resize can bind to it again
+    void release(AliasedMemory* memory){
+        if(--memory->users > 0) return;
+
+        for(auto& c : current){
+            if(c.second == memory) return;
+        }
+        free(memory);
+    }
+
+    void free(AliasedMemory* memory){
+        allocator->free(memory->allocation);
+        delete memory;
+    }
+};
@@ -9,6 +9,9 @@
 #include "DeviceHandler.h"
 #include "BufferHelpers.h"
 #include <chrono>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
 
 struct UniformBufferObject{
     alignas(16) glm::mat4 model;
@@ -16,43 +19,87 @@ struct UniformBufferObject{
     alignas(16) glm::mat4 projection;
 };
 
+//one persistently mapped buffer per frame in flight, handing out aligned slices front to back
+//slices are bound through the UNIFORM_BUFFER_DYNAMIC descriptor by their offset, a frame's slices are all dropped at once by reset
 class UniformBuffers{
 public:
 	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
-	std::vector<void*> uniformBuffersMapped;
+	std::vector<MemoryAllocation> uniformBuffersAllocations;
+	std::vector<unsigned char*> uniformBuffersMapped;
+	std::vector<VkDeviceSize> heads; //next free byte of every frame's buffer
+
+	VkDeviceSize capacity = UNIFORM_ARENA_SIZE;
+	VkDeviceSize alignment;
 
     DeviceHandler* deviceHandler;
 	SwapchainHandler* swapchainHandler;
 
 public:
     UniformBuffers(DeviceHandler* _dh, SwapchainHandler* _sh) : deviceHandler(_dh), swapchainHandler(_sh){ //device handler needed for buffer helpers
-        createUniformBuffers();
+        alignment = deviceHandler->getCapabilities().getLimits().minUniformBufferOffsetAlignment;
+
+        createUniformBuffers(deviceHandler->getFrameTimeline().getFramesInFlight());
     }
 
     ~UniformBuffers(){
-        for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){
-			vkDestroyBuffer(deviceHandler->getLogicalDevice(), uniformBuffers[i], nullptr);
-			vkFreeMemory(deviceHandler->getLogicalDevice(), uniformBuffersMemory[i], nullptr);
-		}
+        destroyUniformBuffers(0);
     }
 
+	//one buffer per frame in flight, no frame may be executing while the count changes
+	void setFrameCount(uint32_t count){
+		if(count < uniformBuffers.size()) destroyUniformBuffers(count);
+		else if(count > uniformBuffers.size()) createUniformBuffers(count);
+	}
+
 	inline std::vector<VkBuffer>& getBuffers(){ return uniformBuffers; }
 
-	void createUniformBuffers(){
-		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+	//call once the frame that last used this slot has finished, nothing still executing reads its slices then
+	inline void reset(uint32_t frame){ heads[frame] = 0; }
+
+	//reserves size bytes for frame and returns their dynamic offset, mapped points at them
+	uint32_t allocate(VkDeviceSize size, uint32_t frame, void*& mapped){
+		VkDeviceSize offset = (heads[frame] + alignment - 1) / alignment * alignment;
+		if(offset + size > capacity) throw std::runtime_error("Uniform arena of the frame is full, raise UNIFORM_ARENA_SIZE.\n");
 
-		uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-		uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-		uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+		heads[frame] = offset + size;
+		mapped = uniformBuffersMapped[frame] + offset;
+		return static_cast<uint32_t>(offset);
+	}
+
+	template<typename T>
+	uint32_t push(const T& data, uint32_t frame){
+		void* mapped;
+		uint32_t offset = allocate(sizeof(T), frame, mapped);
+		memcpy(mapped, &data, sizeof(T));
+		return offset;
+	}
+
+	//creates the buffers of the frame slots from the current count up to count
+	void createUniformBuffers(uint32_t count){
+		size_t first = uniformBuffers.size();
+		uniformBuffers.resize(count);
+		uniformBuffersAllocations.resize(count);
+		uniformBuffersMapped.resize(count);
+		heads.resize(count, 0);
+
+		for(size_t i = first; i < count; ++i){
+			BufferHelpers::CreateBuffer(capacity, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersAllocations[i], deviceHandler);
+			uniformBuffersMapped[i] = static_cast<unsigned char*>(uniformBuffersAllocations[i].mapped);
+		}
+	}
 
-		for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i){
-			BufferHelpers::CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i], deviceHandler);
-			vkMapMemory(deviceHandler->getLogicalDevice(), uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+	void destroyUniformBuffers(size_t first){
+		for(size_t i = first; i < uniformBuffers.size(); ++i){
+			BufferHelpers::DestroyBuffer(uniformBuffers[i], uniformBuffersAllocations[i], deviceHandler);
 		}
+		uniformBuffers.resize(first);
+		uniformBuffersAllocations.resize(first);
+		uniformBuffersMapped.resize(first);
+		heads.resize(first);
 	}
 
-	void updateUniformBuffer(UniformBufferObject& ubo, uint32_t currentImage){
-		memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+	//the camera's matrices for this frame, returns the dynamic offset to bind them with
+	uint32_t updateUniformBuffer(UniformBufferObject& ubo, uint32_t currentImage){
+		return push(ubo, currentImage);
 	}
 };
\ No newline at end of file
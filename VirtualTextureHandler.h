@@ -0,0 +1,586 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above
+
+#include <vector>
+#include <deque>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "Globals.h"
+#include "DeviceHandler.h"
+#include "CommandBuffersHandler.h"
+#include "BufferHelpers.h"
+#include "ImageHelpers.h"
+#include "BarrierBatcher.h"
+#include "AllocationTracker.h"
+#include "StbImage.h"
+
+const uint32_t VT_FILE_MAGIC = 0x58455456; //"VTEX"
+const uint32_t VT_INVALID_PAGE = 0xFFFFFFFF;
+
+//tiled texture file: this header, then every page of every mip level as raw RGBA8
+//levels are stored finest first, pages of a level row by row, texels of a page row by row
+struct VirtualTextureFileHeader{
+    uint32_t magic;
+    uint32_t pageSize; //texels per side of a page
+    uint32_t pagesPerSide; //pages per side at mip 0, a power of two no larger than 256
+    uint32_t mipLevels; //down to a single page
+};
+
+//a large texture split into pages, of which only the ones the feedback pass asked for are kept in a physical cache texture
+//shaders find a page's place in the cache through the page table texture, falling back to coarser pages while it loads
+class VirtualTextureHandler{
+    struct CacheSlot{
+        uint32_t key = VT_INVALID_PAGE; //page held by this slot
+        uint64_t lastUsedFrame = 0;
+        bool pinned = false; //the coarsest page always stays so every lookup has something to fall back to
+    };
+
+    struct LoadedPage{
+        uint32_t key;
+        std::vector<unsigned char> pixels;
+    };
+
+    std::string tilePath;
+    VirtualTextureFileHeader header;
+    VkDeviceSize pageBytes;
+
+    VkImage cacheImage;
+    MemoryAllocation cacheImageAllocation;
+    VkImageView cacheImageView;
+    VkSampler cacheSampler;
+    std::vector<CacheSlot> slots;
+    std::unordered_map<uint32_t, uint32_t> residentPages; //page key -> slot
+
+    VkImage pageTableImage;
+    MemoryAllocation pageTableImageAllocation;
+    VkImageView pageTableImageView;
+    VkSampler pageTableSampler;
+    std::vector<std::vector<uint32_t>> pageTable; //per mip, one RGBA8 entry per page
+    VkDeviceSize pageTableBytes;
+    bool pageTableDirty = true;
+
+    //pages and the page table go through here on their way to the gpu, one region per frame in flight
+    //a frame slot's region was last read by an upload submitted before that slot's previous frame, so it is free again once the slot is
+    VkBuffer uploadBuffer;
+    MemoryAllocation uploadBufferAllocation;
+    unsigned char* uploadMapped;
+    VkDeviceSize uploadRegionBytes;
+    std::vector<uint64_t> uploadSerials; //per region, the submit last reading it
+
+    VkExtent2D feedbackExtent; //the render graph renders the feedback pass into feedbackImages, with a transient depth buffer of its own
+    std::vector<VkImage> feedbackImages; //one per frame in flight, each frame's requests are read back once it has finished
+    std::vector<MemoryAllocation> feedbackImagesAllocations;
+    std::vector<VkImageView> feedbackImageViews;
+    std::vector<VkBuffer> readbackBuffers;
+    std::vector<MemoryAllocation> readbackBuffersAllocations;
+    std::vector<void*> readbackMapped;
+    std::vector<uint32_t> frameRequests; //scratch, reused every frame: the distinct pages of one frame's feedback
+    std::vector<LoadedPage> readyPages; //scratch for update
+    std::vector<VkBufferImageCopy> pageRegions; //scratch for uploadPages
+    std::vector<VkBufferImageCopy> tableRegions;
+    BarrierBatcher barriers;
+
+    std::thread loaderThread;
+    std::mutex loaderMutex;
+    std::condition_variable loaderCondition;
+    std::deque<uint32_t> requestQueue;
+    std::unordered_set<uint32_t> requestedPages; //queued, loading or waiting for upload, so no page is requested twice
+    std::vector<LoadedPage> loadedPages;
+    bool stopLoader = false;
+
+    uint64_t frameNumber = 0;
+    uint64_t pageChangeCount = 0; //bumped by every page requested, uploaded or evicted, the bookkeeping of which allocates
+
+    DeviceHandler* deviceHandler;
+    CommandBuffersHandler* commandBuffersHandler;
+
+public:
+    VirtualTextureHandler(const char* _tilePath, const char* sourcePath, DeviceHandler*& _dh, CommandBuffersHandler*& _cbh, VkExtent2D swapchainExtent)
+    : tilePath(_tilePath), barriers(_dh), deviceHandler(_dh), commandBuffersHandler(_cbh){
+        if(!std::ifstream(tilePath, std::ios::binary).good()) bakeTileFile(sourcePath);
+        readHeader();
+
+        createCache();
+        createPageTable();
+        createUploadBuffer(deviceHandler->getFrameTimeline().getFramesInFlight());
+        createFeedbackResources(swapchainExtent);
+
+        //the coarsest page is loaded up front and never evicted
+        LoadedPage coarsest;
+        coarsest.key = makeKey(0, 0, header.mipLevels - 1);
+        coarsest.pixels.resize(pageBytes);
+        std::ifstream file(tilePath, std::ios::binary);
+        if(!readPage(file, coarsest.key, coarsest.pixels.data())) throw std::runtime_error("Failed to read page from tiled texture file.\n");
+
+        std::vector<LoadedPage> ready;
+        ready.push_back(std::move(coarsest));
+        uploadPages(ready, 0);
+        slots[residentPages[makeKey(0, 0, header.mipLevels - 1)]].pinned = true;
+
+        loaderThread = std::thread(&VirtualTextureHandler::loaderLoop, this);
+
+        if(DEBUG) std::cout << "Virtual texture " << tilePath << ": " << header.pagesPerSide << "x" << header.pagesPerSide << " pages of " << header.pageSize << " texels, " << header.mipLevels << " mip levels\n";
+    }
+
+    ~VirtualTextureHandler(){
+        {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            stopLoader = true;
+        }
+        loaderCondition.notify_all();
+        loaderThread.join();
+
+        VkDevice& device = deviceHandler->getLogicalDevice();
+
+        destroyFeedbackFrames(0);
+
+        BufferHelpers::DestroyBuffer(uploadBuffer, uploadBufferAllocation, deviceHandler);
+
+        vkDestroySampler(device, pageTableSampler, nullptr);
+        vkDestroyImageView(device, pageTableImageView, nullptr);
+        ImageHelpers::DestroyImage(pageTableImage, pageTableImageAllocation, deviceHandler);
+
+        vkDestroySampler(device, cacheSampler, nullptr);
+        vkDestroyImageView(device, cacheImageView, nullptr);
+        ImageHelpers::DestroyImage(cacheImage, cacheImageAllocation, deviceHandler);
+    }
+
+    inline VkImageView getCacheImageView(){ return cacheImageView; }
+    inline VkSampler getCacheSampler(){ return cacheSampler; }
+    inline VkImageView getPageTableImageView(){ return pageTableImageView; }
+    inline VkSampler getPageTableSampler(){ return pageTableSampler; }
+    inline VkExtent2D& getFeedbackExtent(){ return feedbackExtent; }
+    inline std::vector<VkImage>& getFeedbackImages(){ return feedbackImages; }
+    inline std::vector<VkImageView>& getFeedbackImageViews(){ return feedbackImageViews; }
+    inline std::vector<VkBuffer>& getReadbackBuffers(){ return readbackBuffers; }
+    inline uint64_t getPageChangeCount(){ return pageChangeCount; }
+
+    //feedback image, readback buffer and upload region per frame in flight, no frame or upload may be executing while the count changes
+    //requests of the frames dropped are lost, they are made again by the next frames that need the pages
+    void setFrameCount(uint32_t count){
+        if(count < feedbackImages.size()) destroyFeedbackFrames(count);
+        else if(count > feedbackImages.size()) createFeedbackFrames(count);
+
+        if(count != uploadSerials.size()){
+            BufferHelpers::DestroyBuffer(uploadBuffer, uploadBufferAllocation, deviceHandler);
+            createUploadBuffer(count);
+        }
+    }
+
+    //call once per frame after the frame last using currentFrame's slot has finished: reads back what that frame requested and uploads loaded pages
+    void update(uint32_t currentFrame){
+        ++frameNumber;
+        processFeedback(currentFrame);
+
+        //normally long done, otherwise loaded pages wait for a later frame rather than for the gpu
+        if(!commandBuffersHandler->isUploadFinished(uploadSerials[currentFrame])) return;
+
+        readyPages.clear();
+        {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            size_t count = std::min(loadedPages.size(), static_cast<size_t>(VT_MAX_UPLOADS_PER_FRAME));
+            for(size_t i = 0; i < count; ++i) readyPages.push_back(std::move(loadedPages[i]));
+            loadedPages.erase(loadedPages.begin(), loadedPages.begin() + count);
+        }
+
+        if(!readyPages.empty() || pageTableDirty) uploadPages(readyPages, currentFrame);
+    }
+
+    //after the feedback pass: copy this frame's requests somewhere the cpu can read them once the frame has finished
+    //the render graph orders it after the feedback pass and makes the copy visible to the host
+    void recordFeedbackReadback(VkCommandBuffer commandBuffer, uint32_t currentFrame){
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {feedbackExtent.width, feedbackExtent.height, 1};
+
+        vkCmdCopyImageToBuffer(commandBuffer, feedbackImages[currentFrame], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffers[currentFrame], 1, &region);
+    }
+
+private:
+    inline uint32_t makeKey(uint32_t x, uint32_t y, uint32_t mip){ return x | (y << 8) | (mip << 16); }
+    inline uint32_t keyX(uint32_t key){ return key & 0xFF; }
+    inline uint32_t keyY(uint32_t key){ return (key >> 8) & 0xFF; }
+    inline uint32_t keyMip(uint32_t key){ return key >> 16; }
+    inline uint32_t pagesAtMip(uint32_t mip){ return std::max(header.pagesPerSide >> mip, 1u); }
+
+    inline uint32_t packEntry(uint32_t x, uint32_t y, uint32_t mip){ return x | (y << 8) | (mip << 16) | (255u << 24); }
+
+    void processFeedback(uint32_t currentFrame){
+        const uint32_t* requests = static_cast<const uint32_t*>(readbackMapped[currentFrame]);
+        size_t count = static_cast<size_t>(feedbackExtent.width) * feedbackExtent.height;
+
+        //neighbouring pixels mostly ask for the same page, the rest is sorted out afterwards
+        frameRequests.clear();
+        frameRequests.reserve(count);
+        for(size_t i = 0; i < count; ++i){
+            if((requests[i] >> 24) == 0) continue; //nothing drawn here
+            uint32_t key = requests[i] & 0x00FFFFFF;
+            if(frameRequests.empty() || frameRequests.back() != key) frameRequests.push_back(key);
+        }
+        std::sort(frameRequests.begin(), frameRequests.end());
+        frameRequests.erase(std::unique(frameRequests.begin(), frameRequests.end()), frameRequests.end());
+
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        for(uint32_t key : frameRequests){
+            //walk up to the coarsest level so fallbacks stay resident and load before the finer pages
+            std::array<uint32_t, 9> chain;
+            uint32_t chainLength = 0;
+            uint32_t x = keyX(key), y = keyY(key);
+            for(uint32_t mip = keyMip(key); mip < header.mipLevels; ++mip, x /= 2, y /= 2) chain[chainLength++] = makeKey(x, y, mip);
+
+            for(uint32_t i = chainLength; i-- > 0;){
+                auto resident = residentPages.find(chain[i]);
+                if(resident != residentPages.end()) slots[resident->second].lastUsedFrame = frameNumber;
+                else if(requestedPages.insert(chain[i]).second){
+                    requestQueue.push_back(chain[i]);
+                    ++pageChangeCount;
+                }
+            }
+        }
+        loaderCondition.notify_one();
+    }
+
+    //least recently used unpinned slot not needed this frame, or VT_INVALID_PAGE if everything is in use
+    uint32_t allocateSlot(){
+        uint32_t best = VT_INVALID_PAGE;
+        for(uint32_t i = 0; i < slots.size(); ++i){
+            if(slots[i].key == VT_INVALID_PAGE) return i;
+            if(slots[i].pinned || slots[i].lastUsedFrame >= frameNumber) continue;
+            if(best == VT_INVALID_PAGE || slots[i].lastUsedFrame < slots[best].lastUsedFrame) best = i;
+        }
+
+        if(best != VT_INVALID_PAGE){
+            residentPages.erase(slots[best].key);
+            pageTableDirty = true;
+            ++pageChangeCount;
+        }
+        return best;
+    }
+
+    void rebuildPageTable(){
+        //coarsest first so every missing page can take its parent's entry
+        for(uint32_t mip = header.mipLevels; mip-- > 0;){
+            uint32_t pages = pagesAtMip(mip);
+            for(uint32_t y = 0; y < pages; ++y){
+                for(uint32_t x = 0; x < pages; ++x){
+                    uint32_t& entry = pageTable[mip][y * pages + x];
+                    auto resident = residentPages.find(makeKey(x, y, mip));
+
+                    if(resident != residentPages.end()) entry = packEntry(resident->second % VT_CACHE_PAGES, resident->second / VT_CACHE_PAGES, mip);
+                    else if(mip + 1 < header.mipLevels) entry = pageTable[mip + 1][(y / 2) * pagesAtMip(mip + 1) + x / 2];
+                    else entry = 0;
+                }
+            }
+        }
+    }
+
+    //copies the given pages into free cache slots and the page table to the gpu in one submission, staged in the given upload region
+    //submitted without waiting: graphics submits run in order, so frames submitted afterwards sample the new pages and table
+    void uploadPages(std::vector<LoadedPage>& ready, uint32_t region){
+        pageRegions.clear();
+        VkDeviceSize regionOffset = region * uploadRegionBytes;
+
+        for(auto& page : ready){
+            uint32_t slot = allocateSlot();
+
+            {
+                std::lock_guard<std::mutex> lock(loaderMutex);
+                requestedPages.erase(page.key); //if it didn't fit it can be requested again
+            }
+            if(slot == VT_INVALID_PAGE) continue;
+
+            VkDeviceSize offset = regionOffset + pageRegions.size() * pageBytes;
+            memcpy(uploadMapped + offset, page.pixels.data(), static_cast<size_t>(pageBytes));
+
+            slots[slot].key = page.key;
+            slots[slot].lastUsedFrame = frameNumber;
+            residentPages[page.key] = slot;
+            pageTableDirty = true;
+            ++pageChangeCount;
+
+            VkBufferImageCopy region{};
+            region.bufferOffset = offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = 0;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {static_cast<int32_t>((slot % VT_CACHE_PAGES) * header.pageSize), static_cast<int32_t>((slot / VT_CACHE_PAGES) * header.pageSize), 0};
+            region.imageExtent = {header.pageSize, header.pageSize, 1};
+            pageRegions.push_back(region);
+        }
+
+        //page table goes after the largest possible batch of pages
+        tableRegions.clear();
+        if(pageTableDirty){
+            rebuildPageTable();
+
+            VkDeviceSize offset = regionOffset + VT_MAX_UPLOADS_PER_FRAME * pageBytes;
+            for(uint32_t mip = 0; mip < header.mipLevels; ++mip){
+                uint32_t pages = pagesAtMip(mip);
+                memcpy(uploadMapped + offset, pageTable[mip].data(), pageTable[mip].size() * sizeof(uint32_t));
+
+                VkBufferImageCopy region{};
+                region.bufferOffset = offset;
+                region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                region.imageSubresource.mipLevel = mip;
+                region.imageSubresource.baseArrayLayer = 0;
+                region.imageSubresource.layerCount = 1;
+                region.imageOffset = {0, 0, 0};
+                region.imageExtent = {pages, pages, 1};
+                tableRegions.push_back(region);
+
+                offset += pageTable[mip].size() * sizeof(uint32_t);
+            }
+            pageTableDirty = false;
+        }
+
+        if(pageRegions.empty() && tableRegions.empty()) return;
+
+        VkCommandBuffer commandBuffer = commandBuffersHandler->beginSingleTimeCommands();
+
+        //the tracker knows whether they were ever written, the first upload starts them from UNDEFINED
+        barriers.transition(cacheImage, IMAGE_ACCESS_TRANSFER_DST);
+        barriers.transition(pageTableImage, IMAGE_ACCESS_TRANSFER_DST);
+        barriers.flush(commandBuffer);
+
+        if(!pageRegions.empty()) vkCmdCopyBufferToImage(commandBuffer, uploadBuffer, cacheImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(pageRegions.size()), pageRegions.data());
+        if(!tableRegions.empty()) vkCmdCopyBufferToImage(commandBuffer, uploadBuffer, pageTableImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(tableRegions.size()), tableRegions.data());
+
+        barriers.transition(cacheImage, IMAGE_ACCESS_SHADER_READ);
+        barriers.transition(pageTableImage, IMAGE_ACCESS_SHADER_READ);
+        barriers.flush(commandBuffer);
+
+        if(commandBuffersHandler->isUploadBatchOpen()) commandBuffersHandler->endSingleTimeCommands(commandBuffer); //at startup, goes out with the batch
+        else uploadSerials[region] = commandBuffersHandler->endSingleTimeCommandsAsync(commandBuffer);
+    }
+
+    void loaderLoop(){
+        AllocationTracker::ignoreThisThread(); //loads on its own schedule, page buffers are allocated here
+        std::ifstream file(tilePath, std::ios::binary);
+
+        while(true){
+            uint32_t key;
+            {
+                std::unique_lock<std::mutex> lock(loaderMutex);
+                loaderCondition.wait(lock, [this]{ return stopLoader || !requestQueue.empty(); });
+                if(stopLoader) return;
+
+                key = requestQueue.front();
+                requestQueue.pop_front();
+            }
+
+            LoadedPage page;
+            page.key = key;
+            page.pixels.resize(static_cast<size_t>(pageBytes));
+            bool read = readPage(file, key, page.pixels.data());
+
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            if(read) loadedPages.push_back(std::move(page));
+            else requestedPages.erase(key); //truncated file, leave the fallback in place
+        }
+    }
+
+    bool readPage(std::ifstream& file, uint32_t key, unsigned char* dst){
+        VkDeviceSize offset = sizeof(VirtualTextureFileHeader);
+        for(uint32_t mip = 0; mip < keyMip(key); ++mip) offset += static_cast<VkDeviceSize>(pagesAtMip(mip)) * pagesAtMip(mip) * pageBytes;
+        offset += (static_cast<VkDeviceSize>(keyY(key)) * pagesAtMip(keyMip(key)) + keyX(key)) * pageBytes;
+
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(pageBytes));
+        return static_cast<bool>(file);
+    }
+
+    void readHeader(){
+        std::ifstream file(tilePath, std::ios::binary);
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+        if(!file || header.magic != VT_FILE_MAGIC) throw std::runtime_error("Invalid tiled texture file.\n");
+        if(header.pageSize != VT_PAGE_SIZE) throw std::runtime_error("Tiled texture page size does not match VT_PAGE_SIZE.\n");
+        if(header.pagesPerSide > 256 || header.mipLevels > 9) throw std::runtime_error("Tiled texture is too large for 8 bit page coordinates.\n");
+
+        pageBytes = static_cast<VkDeviceSize>(header.pageSize) * header.pageSize * 4;
+
+        pageTable.resize(header.mipLevels);
+        pageTableBytes = 0;
+        for(uint32_t mip = 0; mip < header.mipLevels; ++mip){
+            pageTable[mip].assign(static_cast<size_t>(pagesAtMip(mip)) * pagesAtMip(mip), 0);
+            pageTableBytes += pageTable[mip].size() * sizeof(uint32_t);
+        }
+    }
+
+    //cuts a regular image into a tiled texture file, resampled to a power of two number of pages with box filtered mips
+    void bakeTileFile(const char* sourcePath){
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load(sourcePath, &width, &height, &channels, STBI_rgb_alpha);
+        if(!pixels) throw std::runtime_error("failed to load texture image!");
+
+        VirtualTextureFileHeader out{};
+        out.magic = VT_FILE_MAGIC;
+        out.pageSize = VT_PAGE_SIZE;
+        out.pagesPerSide = 1;
+        while(out.pagesPerSide * out.pageSize < static_cast<uint32_t>(std::max(width, height)) && out.pagesPerSide < 256) out.pagesPerSide *= 2;
+        out.mipLevels = static_cast<uint32_t>(std::log2(out.pagesPerSide)) + 1;
+
+        uint32_t size = out.pagesPerSide * out.pageSize;
+        std::vector<unsigned char> level(static_cast<size_t>(size) * size * 4);
+        for(uint32_t y = 0; y < size; ++y){
+            for(uint32_t x = 0; x < size; ++x){
+                size_t src = ((static_cast<size_t>(y) * height / size) * width + static_cast<size_t>(x) * width / size) * 4;
+                memcpy(&level[(static_cast<size_t>(y) * size + x) * 4], pixels + src, 4);
+            }
+        }
+        stbi_image_free(pixels);
+
+        std::ofstream file(tilePath, std::ios::binary);
+        if(!file) throw std::runtime_error("Failed to create tiled texture file.\n");
+        file.write(reinterpret_cast<const char*>(&out), sizeof(out));
+
+        for(uint32_t mip = 0; mip < out.mipLevels; ++mip){
+            uint32_t pages = size / out.pageSize;
+            for(uint32_t py = 0; py < pages; ++py){
+                for(uint32_t px = 0; px < pages; ++px){
+                    for(uint32_t row = 0; row < out.pageSize; ++row){
+                        size_t start = ((static_cast<size_t>(py) * out.pageSize + row) * size + px * out.pageSize) * 4;
+                        file.write(reinterpret_cast<const char*>(&level[start]), out.pageSize * 4);
+                    }
+                }
+            }
+
+            if(mip + 1 == out.mipLevels) break;
+
+            size_t half = size / 2;
+            std::vector<unsigned char> next(half * half * 4);
+            for(size_t y = 0; y < half; ++y){
+                for(size_t x = 0; x < half; ++x){
+                    size_t top = ((2 * y) * size + 2 * x) * 4;
+                    size_t bottom = top + static_cast<size_t>(size) * 4;
+                    for(size_t c = 0; c < 4; ++c){
+                        uint32_t sum = level[top + c] + level[top + 4 + c] + level[bottom + c] + level[bottom + 4 + c];
+                        next[(y * half + x) * 4 + c] = static_cast<unsigned char>(sum / 4);
+                    }
+                }
+            }
+            level.swap(next);
+            size = static_cast<uint32_t>(half);
+        }
+
+        if(DEBUG) std::cout << "Baked tiled texture " << tilePath << " from " << sourcePath << '\n';
+    }
+
+    void createCache(){
+        uint32_t size = VT_CACHE_PAGES * header.pageSize;
+        ImageHelpers::CreateImage(size, size, 1, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cacheImage, cacheImageAllocation, deviceHandler);
+        cacheImageView = ImageHelpers::CreateImageView(cacheImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, 1, deviceHandler->getLogicalDevice());
+        cacheSampler = createSampler(VK_FILTER_LINEAR);
+
+        slots.resize(VT_CACHE_PAGES * VT_CACHE_PAGES);
+    }
+
+    void createPageTable(){
+        ImageHelpers::CreateImage(header.pagesPerSide, header.pagesPerSide, header.mipLevels, VK_FORMAT_R8G8B8A8_UINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pageTableImage, pageTableImageAllocation, deviceHandler);
+        pageTableImageView = ImageHelpers::CreateImageView(pageTableImage, VK_FORMAT_R8G8B8A8_UINT, VK_IMAGE_ASPECT_COLOR_BIT, header.mipLevels, deviceHandler->getLogicalDevice());
+        pageTableSampler = createSampler(VK_FILTER_NEAREST); //integer formats can't be filtered, the shaders only texelFetch it anyway
+    }
+
+    void createUploadBuffer(uint32_t regionCount){
+        uploadRegionBytes = VT_MAX_UPLOADS_PER_FRAME * pageBytes + pageTableBytes;
+        uploadSerials.assign(regionCount, 0);
+
+        VkDeviceSize size = uploadRegionBytes * regionCount;
+        BufferHelpers::CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uploadBuffer, uploadBufferAllocation, deviceHandler);
+        uploadMapped = static_cast<unsigned char*>(uploadBufferAllocation.mapped);
+    }
+
+    VkSampler createSampler(VkFilter filter){
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = filter;
+        samplerInfo.minFilter = filter;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxAnisotropy = 1.0f;
+        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = static_cast<float>(header.mipLevels);
+        samplerInfo.mipLodBias = 0.0f;
+
+        VkSampler sampler;
+        if(vkCreateSampler(deviceHandler->getLogicalDevice(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) throw std::runtime_error("Failed to create virtual texture sampler.\n");
+        return sampler;
+    }
+
+    void createFeedbackResources(VkExtent2D swapchainExtent){
+        //fixed at creation, requests only need to be roughly where the pixels are
+        feedbackExtent.width = std::max(swapchainExtent.width / VT_FEEDBACK_DIVISOR, 1u);
+        feedbackExtent.height = std::max(swapchainExtent.height / VT_FEEDBACK_DIVISOR, 1u);
+
+        createFeedbackFrames(deviceHandler->getFrameTimeline().getFramesInFlight());
+    }
+
+    //creates the per frame feedback resources of the slots from the current count up to count
+    void createFeedbackFrames(uint32_t count){
+        VkDevice& device = deviceHandler->getLogicalDevice();
+        VkDeviceSize readbackSize = static_cast<VkDeviceSize>(feedbackExtent.width) * feedbackExtent.height * 4;
+        size_t first = feedbackImages.size();
+
+        feedbackImages.resize(count);
+        feedbackImagesAllocations.resize(count);
+        feedbackImageViews.resize(count);
+        readbackBuffers.resize(count);
+        readbackBuffersAllocations.resize(count);
+        readbackMapped.resize(count);
+
+        for(size_t i = first; i < count; ++i){
+            ImageHelpers::CreateImage(feedbackExtent.width, feedbackExtent.height, 1, VK_FORMAT_R8G8B8A8_UINT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, feedbackImages[i], feedbackImagesAllocations[i], deviceHandler);
+            feedbackImageViews[i] = ImageHelpers::CreateImageView(feedbackImages[i], VK_FORMAT_R8G8B8A8_UINT, VK_IMAGE_ASPECT_COLOR_BIT, 1, device);
+
+            BufferHelpers::CreateBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, BufferHelpers::GetHostReadableFlags(deviceHandler), readbackBuffers[i], readbackBuffersAllocations[i], deviceHandler);
+            readbackMapped[i] = readbackBuffersAllocations[i].mapped;
+            memset(readbackMapped[i], 0, static_cast<size_t>(readbackSize)); //no requests until the frame has run once
+        }
+    }
+
+    void destroyFeedbackFrames(size_t first){
+        VkDevice& device = deviceHandler->getLogicalDevice();
+
+        for(size_t i = first; i < feedbackImages.size(); ++i){
+            vkDestroyImageView(device, feedbackImageViews[i], nullptr);
+            ImageHelpers::DestroyImage(feedbackImages[i], feedbackImagesAllocations[i], deviceHandler);
+            BufferHelpers::DestroyBuffer(readbackBuffers[i], readbackBuffersAllocations[i], deviceHandler);
+        }
+
+        feedbackImages.resize(first);
+        feedbackImagesAllocations.resize(first);
+        feedbackImageViews.resize(first);
+        readbackBuffers.resize(first);
+        readbackBuffersAllocations.resize(first);
+        readbackMapped.resize(first);
+    }
+};
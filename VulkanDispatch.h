@@ -0,0 +1,165 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+//vulkan.h is loaded above, built with VK_NO_PROTOTYPES (see the Makefile): every vk* command is one of the pointers below
+
+#include <stdexcept>
+
+#ifndef VK_NO_PROTOTYPES
+#error "VulkanDispatch.h declares the vk* commands itself, compile with -DVK_NO_PROTOTYPES"
+#endif
+
+//commands are called through pointers named like them, so call sites stay plain vk* calls
+//device commands come from vkGetDeviceProcAddr and go straight to the driver instead of through the loader's trampolines, which dispatch on the handle first
+//there is one instance and one device: InstanceHandler loads the global and instance commands, DeviceHandler the device ones right after creating theirs
+//the executable must not link the loader, its exports would clash with these names; glfw opens it and hands out vkGetInstanceProcAddr
+
+#define VULKAN_GLOBAL_COMMANDS(X) \
+    X(vkCreateInstance) \
+    X(vkEnumerateInstanceExtensionProperties) \
+    X(vkEnumerateInstanceLayerProperties)
+
+#define VULKAN_INSTANCE_COMMANDS(X) \
+    X(vkDestroyInstance) \
+    X(vkEnumeratePhysicalDevices) \
+    X(vkEnumerateDeviceExtensionProperties) \
+    X(vkGetPhysicalDeviceProperties) \
+    X(vkGetPhysicalDeviceProperties2) \
+    X(vkGetPhysicalDeviceFeatures) \
+    X(vkGetPhysicalDeviceFeatures2) \
+    X(vkGetPhysicalDeviceFormatProperties) \
+    X(vkGetPhysicalDeviceMemoryProperties) \
+    X(vkGetPhysicalDeviceMemoryProperties2) \
+    X(vkGetPhysicalDeviceQueueFamilyProperties) \
+    X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+    X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+    X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+    X(vkGetPhysicalDeviceSurfacePresentModesKHR) \
+    X(vkDestroySurfaceKHR) \
+    X(vkCreateDevice) \
+    X(vkGetDeviceProcAddr)
+
+#define VULKAN_DEVICE_COMMANDS(X) \
+    X(vkDestroyDevice) \
+    X(vkDeviceWaitIdle) \
+    X(vkGetDeviceQueue) \
+    X(vkQueueSubmit) \
+    X(vkQueueWaitIdle) \
+    X(vkAllocateMemory) \
+    X(vkFreeMemory) \
+    X(vkMapMemory) \
+    X(vkCreateBuffer) \
+    X(vkDestroyBuffer) \
+    X(vkBindBufferMemory) \
+    X(vkGetBufferMemoryRequirements) \
+    X(vkCreateImage) \
+    X(vkDestroyImage) \
+    X(vkBindImageMemory) \
+    X(vkGetImageMemoryRequirements) \
+    X(vkGetImageMemoryRequirements2) \
+    X(vkCreateImageView) \
+    X(vkDestroyImageView) \
+    X(vkCreateSampler) \
+    X(vkDestroySampler) \
+    X(vkCreateShaderModule) \
+    X(vkDestroyShaderModule) \
+    X(vkCreateRenderPass) \
+    X(vkDestroyRenderPass) \
+    X(vkCreateFramebuffer) \
+    X(vkDestroyFramebuffer) \
+    X(vkCreatePipelineLayout) \
+    X(vkDestroyPipelineLayout) \
+    X(vkCreateGraphicsPipelines) \
+    X(vkDestroyPipeline) \
+    X(vkCreateDescriptorSetLayout) \
+    X(vkDestroyDescriptorSetLayout) \
+    X(vkCreateDescriptorPool) \
+    X(vkDestroyDescriptorPool) \
+    X(vkAllocateDescriptorSets) \
+    X(vkFreeDescriptorSets) \
+    X(vkUpdateDescriptorSets) \
+    X(vkCreateCommandPool) \
+    X(vkDestroyCommandPool) \
+    X(vkResetCommandPool) \
+    X(vkAllocateCommandBuffers) \
+    X(vkFreeCommandBuffers) \
+    X(vkBeginCommandBuffer) \
+    X(vkEndCommandBuffer) \
+    X(vkCreateFence) \
+    X(vkDestroyFence) \
+    X(vkGetFenceStatus) \
+    X(vkWaitForFences) \
+    X(vkCreateSemaphore) \
+    X(vkDestroySemaphore) \
+    X(vkGetSemaphoreCounterValue) \
+    X(vkWaitSemaphores) \
+    X(vkCmdPipelineBarrier) \
+    X(vkCmdBeginRenderPass) \
+    X(vkCmdEndRenderPass) \
+    X(vkCmdExecuteCommands) \
+    X(vkCmdBindPipeline) \
+    X(vkCmdBindDescriptorSets) \
+    X(vkCmdBindVertexBuffers) \
+    X(vkCmdBindIndexBuffer) \
+    X(vkCmdPushConstants) \
+    X(vkCmdSetViewport) \
+    X(vkCmdSetScissor) \
+    X(vkCmdDrawIndexed) \
+    X(vkCmdCopyBuffer) \
+    X(vkCmdCopyBufferToImage) \
+    X(vkCmdCopyImageToBuffer) \
+    X(vkCmdCopyImage) \
+    X(vkCmdBlitImage) \
+    X(vkCreateSwapchainKHR) \
+    X(vkDestroySwapchainKHR) \
+    X(vkGetSwapchainImagesKHR) \
+    X(vkAcquireNextImageKHR) \
+    X(vkQueuePresentKHR)
+
+//from extensions that are only enabled when available, null otherwise; check DeviceHandler before calling them
+#define VULKAN_OPTIONAL_DEVICE_COMMANDS(X) \
+    X(vkCmdPipelineBarrier2KHR)
+
+#define VULKAN_DECLARE_COMMAND(name) inline PFN_##name name = nullptr;
+inline PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+VULKAN_GLOBAL_COMMANDS(VULKAN_DECLARE_COMMAND)
+VULKAN_INSTANCE_COMMANDS(VULKAN_DECLARE_COMMAND)
+VULKAN_DEVICE_COMMANDS(VULKAN_DECLARE_COMMAND)
+VULKAN_OPTIONAL_DEVICE_COMMANDS(VULKAN_DECLARE_COMMAND)
+#undef VULKAN_DECLARE_COMMAND
+
+namespace VulkanDispatch {
+    //what instance creation needs, glfw must have been initialized
+    void LoadGlobalCommands(){
+        vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(glfwGetInstanceProcAddress(nullptr, "vkGetInstanceProcAddr"));
+        if(vkGetInstanceProcAddr == nullptr) throw std::runtime_error("Failed to find the Vulkan loader.\n");
+
+#define VULKAN_LOAD_COMMAND(name) \
+        name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(nullptr, #name)); \
+        if(name == nullptr) throw std::runtime_error("Failed to load " #name ".\n");
+        VULKAN_GLOBAL_COMMANDS(VULKAN_LOAD_COMMAND)
+#undef VULKAN_LOAD_COMMAND
+    }
+
+    void LoadInstanceCommands(VkInstance instance){
+#define VULKAN_LOAD_COMMAND(name) \
+        name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(instance, #name)); \
+        if(name == nullptr) throw std::runtime_error("Failed to load " #name ".\n");
+        VULKAN_INSTANCE_COMMANDS(VULKAN_LOAD_COMMAND)
+#undef VULKAN_LOAD_COMMAND
+    }
+
+    //right after vkCreateDevice, optional commands stay null where their extension is missing
+    void LoadDeviceCommands(VkDevice device){
+#define VULKAN_LOAD_COMMAND(name) \
+        name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name)); \
+        if(name == nullptr) throw std::runtime_error("Failed to load " #name ".\n");
+        VULKAN_DEVICE_COMMANDS(VULKAN_LOAD_COMMAND)
+#undef VULKAN_LOAD_COMMAND
+
+#define VULKAN_LOAD_COMMAND(name) name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name));
+        VULKAN_OPTIONAL_DEVICE_COMMANDS(VULKAN_LOAD_COMMAND)
+#undef VULKAN_LOAD_COMMAND
+    }
+}
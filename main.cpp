@@ -1,5 +1,31 @@
 #include "Renderer.h"
 
+#include <new>
+#include <cstdlib>
+
+#if DEBUG
+//replaced once for the whole program so AllocationTracker can count allocations, the array, nothrow and sized forms of the standard library call these
+void* operator new(std::size_t size){
+	AllocationTracker::count();
+	if(size == 0) size = 1;
+	if(void* p = std::malloc(size)) return p;
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment){
+	AllocationTracker::count();
+	std::size_t align = static_cast<std::size_t>(alignment);
+	size = (size + align - 1) / align * align; //aligned_alloc wants a multiple of the alignment
+	if(void* p = std::aligned_alloc(align, size == 0 ? align : size)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept{ std::free(p); }
+void operator delete(void* p, std::size_t) noexcept{ std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept{ std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept{ std::free(p); }
+#endif
+
 int main(){
 	Renderer renderer;
 
@@ -1,2 +1,6 @@
 /usr/local/bin/glslc shader.vert -o vert.spv
-/usr/local/bin/glslc shader.frag -o frag.spv
\ No newline at end of file
+/usr/local/bin/glslc shader.frag -o frag.spv
+/usr/local/bin/glslc -DTEXTURE_ARRAY shader.frag -o frag_array.spv
+/usr/local/bin/glslc -DBINDLESS shader.frag -o frag_bindless.spv
+/usr/local/bin/glslc -DVIRTUAL_TEXTURING shader.frag -o frag_vt.spv
+/usr/local/bin/glslc vt_feedback.frag -o vt_feedback.spv
\ No newline at end of file
@@ -1,6 +1,30 @@
 #version 450
 
+#ifdef VIRTUAL_TEXTURING
+layout(binding = 1) uniform sampler2D physicalCache; //resident pages laid out in a grid
+layout(binding = 2) uniform usampler2D pageTable; //one texel per virtual page and mip: physical page x, y, mip of the data it holds, valid
+
+const float PAGE_SIZE = 128.0; //VT_PAGE_SIZE
+#elif defined(TEXTURE_ARRAY)
+layout(binding = 1) uniform sampler2DArray texArray;
+
+layout(push_constant) uniform TextureSlot {
+    vec4 uvRemap; //xy scale, zw offset of the texture inside its layer
+    uint layer;
+} slot;
+#elif defined(BINDLESS)
+#extension GL_EXT_nonuniform_qualifier : require //runtime sized sampler arrays indexed by a variable
+
+layout(set = 1, binding = 0) uniform sampler2D textures[]; //the update after bind table, partially bound, only registered elements are valid
+
+layout(push_constant) uniform TextureSlot {
+    vec4 uvRemap;
+    uint layer;
+    uint textureIndex;
+} slot;
+#else
 layout(binding = 1) uniform sampler2D texSampler;
+#endif
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
@@ -8,5 +32,27 @@ layout(location = 1) in vec2 fragTexCoord;
 layout(location = 0) out vec4 outColor;
 
 void main() {
+#ifdef VIRTUAL_TEXTURING
+    vec2 uv = fract(fragTexCoord); //the virtual texture repeats like the regular one
+    vec2 texel = fragTexCoord * vec2(textureSize(pageTable, 0)) * PAGE_SIZE;
+    float lod = 0.5 * log2(max(dot(dFdx(texel), dFdx(texel)), dot(dFdy(texel), dFdy(texel))));
+    int level = clamp(int(lod), 0, textureQueryLevels(pageTable) - 1);
+
+    ivec2 pages = textureSize(pageTable, level);
+    uvec4 entry = texelFetch(pageTable, min(ivec2(uv * vec2(pages)), pages - 1), level);
+
+    //the entry may point at a coarser ancestor page while the requested one is loading
+    vec2 local = fract(uv * vec2(textureSize(pageTable, int(entry.b))));
+    local = clamp(local, vec2(0.5 / PAGE_SIZE), vec2(1.0 - 0.5 / PAGE_SIZE)); //pages have no borders, keep bilinear taps inside the page
+
+    outColor = textureLod(physicalCache, (vec2(entry.rg) + local) * PAGE_SIZE / vec2(textureSize(physicalCache, 0)), 0.0);
+#elif defined(TEXTURE_ARRAY)
+    //wrap first so repeating textures stay inside their atlas entry
+    vec2 uv = fract(fragTexCoord) * slot.uvRemap.xy + slot.uvRemap.zw;
+    outColor = textureGrad(texArray, vec3(uv, float(slot.layer)), dFdx(fragTexCoord) * slot.uvRemap.xy, dFdy(fragTexCoord) * slot.uvRemap.xy);
+#elif defined(BINDLESS)
+    outColor = texture(textures[slot.textureIndex], fragTexCoord); //push constants are dynamically uniform, no nonuniformEXT needed
+#else
     outColor = texture(texSampler, fragTexCoord);
+#endif
 }
@@ -0,0 +1,21 @@
+#version 450
+
+layout(binding = 2) uniform usampler2D pageTable;
+
+const float PAGE_SIZE = 128.0; //VT_PAGE_SIZE
+const float FEEDBACK_LOD_BIAS = 3.0; //log2(VT_FEEDBACK_DIVISOR), derivatives are that much larger at feedback resolution
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out uvec4 outRequest; //page x, page y, mip, 255 to mark the texel as written
+
+void main() {
+    vec2 uv = fract(fragTexCoord);
+    vec2 texel = fragTexCoord * vec2(textureSize(pageTable, 0)) * PAGE_SIZE;
+    float lod = 0.5 * log2(max(dot(dFdx(texel), dFdx(texel)), dot(dFdy(texel), dFdy(texel)))) - FEEDBACK_LOD_BIAS;
+    int level = clamp(int(lod), 0, textureQueryLevels(pageTable) - 1);
+
+    ivec2 pages = textureSize(pageTable, level);
+    outRequest = uvec4(uvec2(min(ivec2(uv * vec2(pages)), pages - 1)), uint(level), 255u);
+}